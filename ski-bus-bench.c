@@ -0,0 +1,420 @@
+/** AUTHOR
+_______________________________
+
+ * Name: Martin Mendl
+ * Email: x247581@fit.vutbr.cz
+ * Date: 26.4. 2024
+ * file: microbenchmark of the bus <-> skier boarding handshake
+_______________________________
+*/
+
+/*
+ * Reproduces the handshake of release_and_wait() in skibus.c: the bus lets n skiers
+ * through a stop and waits on the bus stop sign, until the last skier signals it.
+ * The stop and the sign are built from one primitive at a time, with the skiers
+ * as forked processes or as threads.
+ *
+ * Usage: ./ski-bus-bench [--csv] [K] [ROUNDS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <semaphore.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/**
+ * Rounds run before measuring.
+ */
+#define WARMUP_ROUNDS 100
+
+/**
+ * Spins before a spin then park waiter goes to sleep.
+ */
+#define SPIN_LIMIT 2000
+
+/**
+ * @brief A counting token, built from every primitive, only the fields of the benchmarked one are used.
+ */
+typedef struct {
+    sem_t sem; /**< Process shared semaphore. */
+    int count; /**< Tokens for the futex and spin then park primitives. */
+    int sleepers; /**< Spin then park waiters inside futex_wait. */
+    pthread_mutex_t mutex; /**< Process shared mutex for the condition variable. */
+    pthread_cond_t cond; /**< Process shared condition variable. */
+    int tokens; /**< Tokens guarded by the mutex. */
+    int efd; /**< Eventfd in semaphore mode. */
+} token;
+
+/**
+ * @brief A handshake primitive.
+ */
+typedef struct {
+    const char *name; /**< Name in the report. */
+    void (*init)(token *t); /**< Initializes a token with no tokens. */
+    void (*post)(token *t, int n); /**< Adds n tokens. */
+    void (*wait)(token *t); /**< Takes one token, blocks if there is none. */
+    void (*destroy)(token *t); /**< Destroys the token. */
+} primitive;
+
+/**
+ * @brief Shared state of one benchmark run.
+ */
+typedef struct {
+    token stop; /**< Skiers wait here for the bus. */
+    token sign; /**< The bus waits here for the last skier. */
+    int pending; /**< Skiers still to board in this round. */
+    bool quit; /**< The skiers should leave after waking up. */
+} handshake;
+
+/**
+ * The primitive benchmarked by the skiers.
+ */
+const primitive *current;
+
+/**
+ * Shared state of the current run.
+ */
+handshake *shared;
+
+/**
+ * @brief Futex syscall, glibc has no wrapper.
+ */
+static long futex(int *uaddr, int op, int val) {
+    return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+/**
+ * @brief Hint to the CPU, that we are spinning.
+ */
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * @brief Returns the monotonic time in nanoseconds.
+ */
+static long long now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* sem_t of the C library */
+
+static void sem_token_init(token *t) {
+    sem_init(&t->sem, 1, 0);
+}
+
+static void sem_token_post(token *t, int n) {
+    for (int i = 0; i < n; i++)
+        sem_post(&t->sem);
+}
+
+static void sem_token_wait(token *t) {
+    while (sem_wait(&t->sem) < 0)
+        ;
+}
+
+static void sem_token_destroy(token *t) {
+    sem_destroy(&t->sem);
+}
+
+/* raw futex over a token count, init_bus_stops() uses one that also counts its sleepers */
+
+static void futex_token_init(token *t) {
+    t->count = 0;
+    t->sleepers = 0;
+}
+
+static void futex_token_post(token *t, int n) {
+    __atomic_fetch_add(&t->count, n, __ATOMIC_RELEASE);
+    futex(&t->count, FUTEX_WAKE, n);
+}
+
+/**
+ * @brief Takes a token if there is one.
+ * @return true if a token was taken.
+ */
+static bool futex_token_try(token *t) {
+    int value = __atomic_load_n(&t->count, __ATOMIC_RELAXED);
+    while (value > 0) {
+        if (__atomic_compare_exchange_n(&t->count, &value, value - 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
+}
+
+static void futex_token_wait(token *t) {
+    while (!futex_token_try(t))
+        futex(&t->count, FUTEX_WAIT, 0);
+}
+
+static void futex_token_destroy(token *t) {
+    (void)t;
+}
+
+/* pthread_cond with PTHREAD_PROCESS_SHARED */
+
+static void cond_token_init(token *t) {
+    pthread_mutexattr_t mutex_attr;
+    pthread_condattr_t cond_attr;
+
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&t->mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&t->cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    t->tokens = 0;
+}
+
+static void cond_token_post(token *t, int n) {
+    pthread_mutex_lock(&t->mutex);
+    t->tokens += n;
+    if (n == 1)
+        pthread_cond_signal(&t->cond);
+    else
+        pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->mutex);
+}
+
+static void cond_token_wait(token *t) {
+    pthread_mutex_lock(&t->mutex);
+    while (t->tokens == 0)
+        pthread_cond_wait(&t->cond, &t->mutex);
+    t->tokens--;
+    pthread_mutex_unlock(&t->mutex);
+}
+
+static void cond_token_destroy(token *t) {
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->mutex);
+}
+
+/* eventfd in semaphore mode, inherited by the forked skiers */
+
+static void eventfd_token_init(token *t) {
+    t->efd = eventfd(0, EFD_SEMAPHORE);
+    if (t->efd < 0) {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void eventfd_token_post(token *t, int n) {
+    uint64_t value = n;
+    while (write(t->efd, &value, sizeof(value)) != sizeof(value))
+        ;
+}
+
+static void eventfd_token_wait(token *t) {
+    uint64_t value;
+    while (read(t->efd, &value, sizeof(value)) != sizeof(value))
+        ;
+}
+
+static void eventfd_token_destroy(token *t) {
+    close(t->efd);
+}
+
+/* spin on the token count, then park on the futex */
+
+static void spin_token_post(token *t, int n) {
+    __atomic_fetch_add(&t->count, n, __ATOMIC_RELEASE);
+    // nobody to wake up, the waiters are still spinning
+    if (__atomic_load_n(&t->sleepers, __ATOMIC_SEQ_CST) > 0)
+        futex(&t->count, FUTEX_WAKE, n);
+}
+
+static void spin_token_wait(token *t) {
+    for (int i = 0; i < SPIN_LIMIT; i++) {
+        if (futex_token_try(t))
+            return;
+        cpu_relax();
+    }
+
+    while (!futex_token_try(t)) {
+        __atomic_fetch_add(&t->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&t->count, __ATOMIC_SEQ_CST) == 0)
+            futex(&t->count, FUTEX_WAIT, 0);
+        __atomic_fetch_sub(&t->sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * The benchmarked primitives.
+ */
+const primitive primitives[] = {
+    { "sem_t", sem_token_init, sem_token_post, sem_token_wait, sem_token_destroy },
+    { "futex", futex_token_init, futex_token_post, futex_token_wait, futex_token_destroy },
+    { "pthread_cond", cond_token_init, cond_token_post, cond_token_wait, cond_token_destroy },
+    { "eventfd", eventfd_token_init, eventfd_token_post, eventfd_token_wait, eventfd_token_destroy },
+    { "spin+park", futex_token_init, spin_token_post, spin_token_wait, futex_token_destroy },
+};
+
+/**
+ * @brief A skier, boards at the stop every round and the last one signals the bus.
+ */
+static void *skier(void *arg) {
+    (void)arg;
+
+    while (1) {
+        current->wait(&shared->stop);
+
+        if (__atomic_load_n(&shared->quit, __ATOMIC_ACQUIRE))
+            return NULL;
+
+        // I am the last one to board
+        if (__atomic_sub_fetch(&shared->pending, 1, __ATOMIC_ACQ_REL) == 0)
+            current->post(&shared->sign, 1);
+    }
+}
+
+/**
+ * @brief Orders the latencies for the percentiles.
+ */
+static int compare_latencies(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Runs the handshake with n skiers and reports the handoff latencies.
+ * @param p The primitive.
+ * @param threads Run the skiers as threads instead of processes.
+ * @param n The amount of skiers.
+ * @param rounds The amount of measured rounds.
+ * @param csv Report as CSV.
+ */
+static void run(const primitive *p, bool threads, int n, int rounds, bool csv) {
+    pthread_t tids[n];
+    pid_t pids[n];
+    long long *latencies = malloc(sizeof(long long) * rounds);
+
+    if (latencies == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    current = p;
+    memset(shared, 0, sizeof(handshake));
+    p->init(&shared->stop);
+    p->init(&shared->sign);
+
+    for (int i = 0; i < n; i++) {
+        if (threads) {
+            // a missing waiter would leave the bus waiting on the sign for good
+            int error = pthread_create(&tids[i], NULL, skier, NULL);
+            if (error != 0) {
+                fprintf(stderr, "pthread_create: %s\n", strerror(error));
+                exit(EXIT_FAILURE);
+            }
+        } else if ((pids[i] = fork()) == 0) {
+            skier(NULL);
+            exit(EXIT_SUCCESS);
+        } else if (pids[i] < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    long long start = 0;
+    for (int round = -WARMUP_ROUNDS; round < rounds; round++) {
+        if (round == 0)
+            start = now_ns();
+
+        long long t0 = now_ns();
+
+        // the bus at the stop, as in release_and_wait()
+        shared->pending = n;
+        p->post(&shared->stop, n);
+        p->wait(&shared->sign);
+
+        if (round >= 0)
+            latencies[round] = now_ns() - t0;
+    }
+    long long total = now_ns() - start;
+
+    // wake everybody up to leave
+    __atomic_store_n(&shared->quit, true, __ATOMIC_RELEASE);
+    p->post(&shared->stop, n);
+    for (int i = 0; i < n; i++) {
+        if (threads)
+            pthread_join(tids[i], NULL);
+        else
+            waitpid(pids[i], NULL, 0);
+    }
+
+    p->destroy(&shared->stop);
+    p->destroy(&shared->sign);
+
+    qsort(latencies, rounds, sizeof(long long), compare_latencies);
+    double throughput = (double)n * rounds / (total / 1e9);
+
+    printf(csv ? "%s,%s,%d,%.2f,%.2f,%.2f,%.2f,%.0f\n" : "%-13s %-8s %3d %10.2f %10.2f %10.2f %10.2f %14.0f\n",
+        p->name, threads ? "thread" : "process", n,
+        latencies[rounds / 2] / 1e3, latencies[rounds * 9 / 10] / 1e3,
+        latencies[rounds * 99 / 100] / 1e3, latencies[rounds - 1] / 1e3, throughput);
+    fflush(stdout);
+
+    free(latencies);
+}
+
+/**
+ * @brief Main function.
+ * @param argc The amount of arguments.
+ * @param argv The arguments.
+ * @return The exit status.
+*/
+int main(int argc, char *argv[]) {
+    bool csv = argc > 1 && strcmp(argv[1], "--csv") == 0;
+    if (csv) {
+        argc--;
+        argv++;
+    }
+
+    long max_n = argc > 1 ? strtol(argv[1], NULL, 10) : 10;
+    long rounds = argc > 2 ? strtol(argv[2], NULL, 10) : 2000;
+    if (argc > 3 || max_n < 1 || rounds < 1) {
+        printf("Usage: ./ski-bus-bench [--csv] [K] [ROUNDS]\n");
+        return 1;
+    }
+
+    shared = mmap(NULL, sizeof(handshake), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, 0, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    // latencies in microseconds, from the first post to the bus waking up
+    printf(csv ? "primitive,mode,n,p50_us,p90_us,p99_us,max_us,skiers_per_s\n" :
+        "%-13s %-8s %3s %10s %10s %10s %10s %14s\n",
+        "primitive", "mode", "n", "p50 us", "p90 us", "p99 us", "max us", "skiers/s");
+    fflush(stdout); // the forked skiers would print it again
+
+    for (size_t p = 0; p < sizeof(primitives) / sizeof(primitives[0]); p++) {
+        for (int threads = 0; threads <= 1; threads++) {
+            for (int n = 1; n <= max_n; n++)
+                run(&primitives[p], threads, n, rounds, csv);
+        }
+    }
+
+    munmap(shared, sizeof(handshake));
+    return 0;
+}
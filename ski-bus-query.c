@@ -0,0 +1,161 @@
+/** AUTHOR
+_______________________________
+
+ * Name: Martin Mendl
+ * Email: x247581@fit.vutbr.cz
+ * Date: 26.4. 2024
+ * file: queries on a log of ski-bus written with --index
+_______________________________
+*/
+
+/*
+ * Maps the log and its index and prints the lines of the events a query selects, in the
+ * order of their IDs, without reading the rest of the log. A skier query gives the whole
+ * timeline of one skier, a stop query every event at one stop, optionally only in a range
+ * of event IDs. Boarding and going to ski are listed at the stop they happen at, even
+ * though their log lines do not name it.
+ *
+ * Usage: ./ski-bus-query [--log FILE] [--type TYPE] [--time] INDEX skier ID
+ *        ./ski-bus-query [--log FILE] [--type TYPE] [--time] INDEX stop ID [FIRST [LAST]]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <sys/mman.h>
+
+#include "skibus.h"
+
+/**
+ * Names of the event types for --type, in the order of skibus_event_type.
+ */
+static const char *type_names[] = {
+    "bus-started", "bus-arrived", "bus-leaving", "bus-arrived-final", "bus-leaving-final", "bus-finished",
+    "started", "arrived", "boarding", "transferring", "ski",
+};
+
+/**
+ * @brief Prints the usage of the program.
+*/
+static void print_usage() {
+    printf("Usage: ./ski-bus-query [--log FILE] [--type TYPE] [--time] INDEX skier ID\n"
+           "       ./ski-bus-query [--log FILE] [--type TYPE] [--time] INDEX stop ID [FIRST [LAST]]\n");
+}
+
+/**
+ * @brief Parses a positive number of a query.
+ * @param text The argument.
+ * @param value Filled with the number.
+ * @return true if it is a positive number.
+*/
+static bool parse_id(const char *text, int *value) {
+    char *endptr;
+    long number = strtol(text, &endptr, 10);
+    *value = number;
+    return *endptr == '\0' && number > 0 && number <= INT_MAX;
+}
+
+/**
+ * @brief Maps the log and checks, that the index was saved for it.
+ * @param file_name The log.
+ * @param size The size the index expects.
+ * @return The mapped log, NULL if it does not match.
+*/
+static const char* map_log(const char *file_name, long long size) {
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long long actual = ftell(file);
+    const char *log = actual == size && size > 0 ?
+        mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0) : MAP_FAILED;
+    fclose(file);
+
+    return log != MAP_FAILED ? log : NULL;
+}
+
+/**
+ * @brief Main function, prints the selected lines to stdout.
+ * @param argc The amount of arguments.
+ * @param argv The arguments.
+ * @return The exit status.
+*/
+int main(int argc, char *argv[]) {
+    const char *log_name = "ski-bus.out";
+    const char *positional[5];
+    int positional_count = 0, type = -1;
+    bool show_time = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            log_name = argv[++i];
+        } else if (strcmp(argv[i], "--type") == 0 && i + 1 < argc) {
+            i++;
+            for (int t = 0; t < (int)(sizeof(type_names) / sizeof(type_names[0])); t++) {
+                if (strcmp(argv[i], type_names[t]) == 0)
+                    type = t;
+            }
+            if (type < 0) {
+                printf("Invalid value for --type!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--time") == 0) {
+            show_time = true;
+        } else if (argv[i][0] != '-' && positional_count < 5) {
+            positional[positional_count++] = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    // INDEX skier ID, or INDEX stop ID [FIRST [LAST]]
+    bool by_skier = positional_count == 3 && strcmp(positional[1], "skier") == 0;
+    bool by_stop = positional_count >= 3 && strcmp(positional[1], "stop") == 0;
+    int key, first = 1, last = INT_MAX;
+
+    if ((!by_skier && !by_stop) || !parse_id(positional[2], &key) ||
+        (positional_count > 3 && !parse_id(positional[3], &first)) ||
+        (positional_count > 4 && !parse_id(positional[4], &last))) {
+        print_usage();
+        return 1;
+    }
+
+    skibus_index *index = skibus_index_open(positional[0]);
+    if (index == NULL) {
+        printf("Invalid index %s!\n", positional[0]);
+        return 1;
+    }
+
+    long long log_size = skibus_index_log_size(index);
+    const char *log = map_log(log_name, log_size);
+    if (log == NULL) {
+        printf("The log %s does not match the index!\n", log_name);
+        skibus_index_destroy(index);
+        return 1;
+    }
+
+    const int *ids = NULL;
+    int count = by_skier ? skibus_index_skier(index, key, &ids) : skibus_index_stop(index, key, first, last, &ids);
+
+    for (int i = 0; i < count; i++) {
+        const skibus_index_entry *entry = skibus_index_event(index, ids[i]);
+        const skibus_index_entry *next = skibus_index_event(index, ids[i] + 1);
+        long long end = next != NULL ? next->offset : log_size;
+
+        if (entry == NULL || (type >= 0 && entry->type != type))
+            continue;
+        if (show_time)
+            printf("%14.6f s  ", entry->model_time_us / 1e6);
+        fwrite(log + entry->offset, 1, end - entry->offset, stdout);
+    }
+
+    munmap((void *)log, log_size);
+    skibus_index_destroy(index);
+    return 0;
+}
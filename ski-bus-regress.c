@@ -0,0 +1,864 @@
+/** AUTHOR
+_______________________________
+
+ * Name: Martin Mendl
+ * Email: x247581@fit.vutbr.cz
+ * Date: 26.4. 2024
+ * file: golden output and performance regression harness of libskibus
+_______________________________
+*/
+
+/*
+ * Runs a fixed corpus of seeded configurations through skibus_run(). Every event of every
+ * run is checked against the protocol of the log, the event counts, that only depend on
+ * the seed, are compared with the goldens in total and per stop, and the wall time and the
+ * events per second are compared with the baseline. The times are measured in units of a
+ * calibration workload timed between the runs of every case, so a slower or busier host slows both
+ * down alike. A slowdown only fails the harness on the host the baseline was taken on. Both
+ * are stored in the regression directory, --update writes them from the current tree.
+ *
+ * Usage: ./ski-bus-regress [--update] [--repeats N] [--tolerance F] [DIR]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "skibus.h"
+
+/**
+ * Timed runs of every case at least, the medians are compared.
+ */
+#define DEFAULT_REPEATS 5
+
+/**
+ * Most timed runs of a case.
+ */
+#define MAX_REPEATS 100
+
+/**
+ * Wall time in microseconds the timed runs of a case add up to at least, short cases are
+ * repeated until then, up to MAX_REPEATS.
+ */
+#define MIN_CASE_US 1000000
+
+/**
+ * Runs of the calibration before every case, one more runs before every timed run of it,
+ * the median of them all is the unit of the case.
+ */
+#define CALIBRATION_RUNS 5
+
+/**
+ * Processes forked and round trips through a pipe of one calibration run, the costs
+ * the simulation is made of.
+ */
+#define CALIBRATION_FORKS 20
+#define CALIBRATION_TRIPS 1000
+
+/**
+ * Longest host name kept in the baseline.
+ */
+#define MAX_HOST 64
+
+/**
+ * Slowdown always tolerated on top of the noise, as a share of the baseline.
+ */
+#define DEFAULT_TOLERANCE 0.25
+
+/**
+ * Median absolute deviations, that count as noise.
+ */
+#define NOISE_MADS 3
+
+/**
+ * Most skiers in a case.
+ */
+#define MAX_CASE_SKIERS 2000
+
+/**
+ * Most protocol violations printed per run.
+ */
+#define MAX_REPORTED 5
+
+/**
+ * Counts kept per case: the skier events, the bus starts and the bus finishes.
+ */
+#define GOLDEN_COUNTS 7
+
+/**
+ * Skier counts kept per stop as well: arrived, boarding, transferring and ski, the counts
+ * 1 to 4 of the goldens. Every skier draws its stops from its own random stream, so they
+ * only depend on the seed too.
+ */
+#define STOP_KINDS 4
+
+/**
+ * @brief One configuration of the corpus.
+ */
+typedef struct {
+    const char *name; /**< Name in the goldens and the baseline. */
+    unsigned int seed; /**< Seed of the random streams. */
+    long L, Z, K, TL, TB; /**< Arguments of the run. */
+    long laps; /**< Laps of every skier. */
+    double time_scale; /**< Factor of model time over real time. */
+    skibus_arrival_profile arrivals; /**< Arrival profile. */
+    skibus_wait_strategy wait; /**< Wait strategy. */
+    skibus_skier_mode skiers; /**< How the skiers run. */
+    int line_count; /**< Lines of the route network, 0 for the default line. */
+    skibus_line lines[3]; /**< The route network. */
+    int capacities[3]; /**< Capacities of the buses, 0 for K. */
+    int segment_count; /**< Segments with a travel time of their own. */
+    skibus_segment segments[3]; /**< Travel times of the segments. */
+} regress_case;
+
+/**
+ * The corpus, new cases go at the end and need --update.
+ */
+static const regress_case corpus[] = {
+    { "classic", 1, 8, 4, 10, 4, 5, 1, 1, SKIBUS_ARRIVALS_NONE, SKIBUS_WAIT_BLOCK, SKIBUS_SKIERS_PROCESS, 0, {{0, {0}}}, {0}, 0, {{0}} },
+    { "crowded", 2, 500, 5, 20, 1000, 100, 2, 1, SKIBUS_ARRIVALS_NONE, SKIBUS_WAIT_BLOCK, SKIBUS_SKIERS_PROCESS, 0, {{0, {0}}}, {0}, 0, {{0}} },
+    { "clone-adaptive", 3, 1000, 10, 50, 1000, 100, 2, 1, SKIBUS_ARRIVALS_NONE, SKIBUS_WAIT_ADAPTIVE, SKIBUS_SKIERS_CLONE, 0, {{0, {0}}}, {0}, 0, {{0}} },
+    { "bursty", 4, 400, 3, 10, 2000, 50, 1, 1, SKIBUS_ARRIVALS_BURSTY, SKIBUS_WAIT_BLOCK, SKIBUS_SKIERS_CLONE, 0, {{0, {0}}}, {0}, 0, {{0}} },
+    { "scaled-peak", 5, 300, 6, 30, 2000000, 200000, 2, 1000, SKIBUS_ARRIVALS_PEAK, SKIBUS_WAIT_BLOCK, SKIBUS_SKIERS_PROCESS, 0, {{0, {0}}}, {0}, 0, {{0}} },
+    { "network", 6, 300, 4, 20, 1000, 100, 2, 1, SKIBUS_ARRIVALS_POISSON, SKIBUS_WAIT_BLOCK, SKIBUS_SKIERS_CLONE,
+        3, { {4, {1, 2, 3, 10}}, {4, {4, 3, 5, 11}}, {3, {6, 10, 11}} }, {0}, 0, {{0}} },
+    { "mixed-fleet", 7, 300, 4, 20, 1000, 100, 2, 1, SKIBUS_ARRIVALS_NONE, SKIBUS_WAIT_BLOCK, SKIBUS_SKIERS_PROCESS,
+        0, {{0, {0}}}, {12}, 3, { {1, 2, SKIBUS_TRAVEL_UNIFORM, 50, 50, 0}, {2, 3, SKIBUS_TRAVEL_EXPONENTIAL, 10, 100, 40},
+        {4, 1, SKIBUS_TRAVEL_UNIFORM, 0, 20, 0} } },
+};
+
+/**
+ * @brief Where a skier is in its lap, as seen in the log.
+ */
+typedef enum {
+    SEEN_NONE, /**< Not started. */
+    SEEN_WALKING, /**< Started or back from skiing. */
+    SEEN_WAITING, /**< Arrived at a stop, or got off to change lines. */
+    SEEN_RIDING, /**< Boarded a bus. */
+} skier_seen;
+
+/**
+ * @brief Checker of the log of one run.
+ */
+typedef struct {
+    const regress_case *c; /**< The case. */
+    int next_id; /**< ID the next event must have. */
+    skier_seen skiers[MAX_CASE_SKIERS]; /**< Where every skier is. */
+    int laps[MAX_CASE_SKIERS]; /**< Laps every skier has finished. */
+    bool started[SKIBUS_MAX_LINES]; /**< The bus has started. */
+    bool finished[SKIBUS_MAX_LINES]; /**< The bus has finished. */
+    int at_stop[SKIBUS_MAX_LINES]; /**< Position of the bus at a stop, -1 while travelling. */
+    int on_board; /**< Riders of the default line. */
+    long long counts[GOLDEN_COUNTS]; /**< Counts compared with the goldens. */
+    long long stop_counts[STOP_KINDS][SKIBUS_MAX_STOPS + 1]; /**< Skier counts per stop compared with the goldens. */
+    long long events; /**< Events of the run. */
+    int violations; /**< Broken rules. */
+} checker;
+
+/**
+ * @brief Golden counts and baseline of one case.
+ */
+typedef struct {
+    bool have_golden; /**< The goldens have the case. */
+    long long golden[GOLDEN_COUNTS]; /**< Golden event counts. */
+    bool have_stops; /**< The goldens have the counts per stop of the case. */
+    long long golden_stops[STOP_KINDS][SKIBUS_MAX_STOPS + 1]; /**< Golden skier counts per stop. */
+    bool have_baseline; /**< The baseline has the case. */
+    double wall, wall_mad; /**< Median wall time in calibration units and its noise. */
+    double rate, rate_mad; /**< Median events per calibration unit and its noise. */
+} case_reference;
+
+/**
+ * Names of the golden counts, in the order of the goldens file.
+ */
+static const char *count_names[GOLDEN_COUNTS] = { "started", "arrived", "boarding", "transferring", "ski", "bus_started", "bus_finished" };
+
+/**
+ * @brief Returns the monotonic time in microseconds.
+ */
+static double now_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+/**
+ * @brief Times one run of the calibration workload, forking processes that exit right away,
+ * then passing a byte back and forth with a child through two pipes. It does not use
+ * libskibus, so it stays the same while the library changes.
+ * @return The wall time in microseconds, negative if a process or a pipe could not be made.
+ */
+static double calibration_run() {
+    double start = now_us();
+    int to_child[2], to_parent[2];
+    char byte = 0;
+
+    for (int i = 0; i < CALIBRATION_FORKS; i++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            return -1;
+        if (pid == 0)
+            _exit(EXIT_SUCCESS);
+        waitpid(pid, NULL, 0);
+    }
+
+    if (pipe(to_child) < 0)
+        return -1;
+    if (pipe(to_parent) < 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // only the parent may hold the other ends, else the child never sees the end of its pipe
+        close(to_child[1]);
+        close(to_parent[0]);
+        while (read(to_child[0], &byte, 1) == 1 && write(to_parent[1], &byte, 1) == 1)
+            ;
+        _exit(EXIT_SUCCESS);
+    }
+
+    bool ok = pid > 0;
+    for (int i = 0; ok && i < CALIBRATION_TRIPS; i++)
+        ok = write(to_child[1], &byte, 1) == 1 && read(to_parent[0], &byte, 1) == 1;
+
+    // the child sees the end of its pipe and exits
+    close(to_child[0]);
+    close(to_child[1]);
+    close(to_parent[0]);
+    close(to_parent[1]);
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+    return ok ? now_us() - start : -1;
+}
+
+/**
+ * @brief Reports a broken rule of the protocol.
+ * @param check The checker.
+ * @param event The event breaking it.
+ * @param rule What is wrong.
+ */
+static void violation(checker *check, const skibus_event *event, const char *rule) {
+    char line[128];
+
+    if (check->violations++ < MAX_REPORTED) {
+        skibus_format_event(event, line, sizeof(line));
+        fprintf(stderr, "  %s: \"%s\": %s\n", check->c->name, line, rule);
+    }
+}
+
+/**
+ * @brief Returns the capacity of the bus of the default line of the case.
+ */
+static int bus_capacity(const regress_case *c) {
+    return c->capacities[0] > 0 ? c->capacities[0] : c->K;
+}
+
+/**
+ * @brief Returns the amount of stops of a line of the case.
+ */
+static int line_length(const regress_case *c, int line) {
+    return c->line_count == 0 ? c->Z : c->lines[line].length;
+}
+
+/**
+ * @brief Returns the ID of the stop at a position of a line of the case.
+ */
+static int line_stop(const regress_case *c, int line, int position) {
+    return c->line_count == 0 ? position + 1 : c->lines[line].stops[position];
+}
+
+/**
+ * @brief Tells whether the bus of any line is at a stop.
+ * @param check The checker.
+ * @param stop The ID of the stop, 0 for any stop.
+ * @param final Only count the final stops, else only the others.
+ */
+static bool bus_at(checker *check, int stop, bool final) {
+    int lines = check->c->line_count == 0 ? 1 : check->c->line_count;
+
+    for (int line = 0; line < lines; line++) {
+        int position = check->at_stop[line];
+        if (position < 0 || (position == line_length(check->c, line) - 1) != final)
+            continue;
+        if (stop == 0 || line_stop(check->c, line, position) == stop)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Tells whether the bus of any line is at a lift, the terminal of a line. A route may
+ * end at a lift in the middle of another line.
+ * @param check The checker.
+ */
+static bool bus_at_lift(checker *check) {
+    int lines = check->c->line_count == 0 ? 1 : check->c->line_count;
+
+    for (int line = 0; line < lines; line++) {
+        if (check->at_stop[line] < 0)
+            continue;
+        int stop = line_stop(check->c, line, check->at_stop[line]);
+        for (int other = 0; other < lines; other++) {
+            if (line_stop(check->c, other, line_length(check->c, other) - 1) == stop)
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Checks an event of a bus.
+ */
+static void check_bus(checker *check, const skibus_event *event) {
+    int line = event->bus > 0 ? event->bus - 1 : 0;
+    int lines = check->c->line_count == 0 ? 1 : check->c->line_count;
+    int last = line_length(check->c, line) - 1;
+
+    if (line >= lines || (event->bus == 0) != (check->c->line_count <= 1)) {
+        violation(check, event, "unknown bus");
+        return;
+    }
+
+    if (event->type == SKIBUS_BUS_STARTED) {
+        if (check->started[line])
+            violation(check, event, "bus started twice");
+        check->started[line] = true;
+        check->counts[5]++;
+        return;
+    }
+
+    if (!check->started[line] || check->finished[line])
+        violation(check, event, "bus event outside of its run");
+
+    switch (event->type) {
+        case SKIBUS_BUS_ARRIVED:
+        case SKIBUS_BUS_ARRIVED_FINAL:
+            if (check->at_stop[line] >= 0)
+                violation(check, event, "bus arrived without leaving the previous stop");
+            // the bus goes round its line, the next stop follows the one it has left
+            check->at_stop[line] = event->type == SKIBUS_BUS_ARRIVED_FINAL ? last : -1;
+            for (int i = 0; event->type == SKIBUS_BUS_ARRIVED && i < last; i++) {
+                if (line_stop(check->c, line, i) == event->stop)
+                    check->at_stop[line] = i;
+            }
+            if (check->at_stop[line] < 0 || line_stop(check->c, line, check->at_stop[line]) != event->stop) {
+                violation(check, event, "bus arrived to a stop, that is not on its line");
+                check->at_stop[line] = 0;
+            }
+            break;
+        case SKIBUS_BUS_LEAVING:
+            if (check->at_stop[line] < 0 || check->at_stop[line] == last || line_stop(check->c, line, check->at_stop[line]) != event->stop)
+                violation(check, event, "bus left a stop it is not at");
+            check->at_stop[line] = -1;
+            break;
+        case SKIBUS_BUS_LEAVING_FINAL:
+            if (check->at_stop[line] != last || line_stop(check->c, line, last) != event->stop)
+                violation(check, event, "bus left the final stop without being there");
+            check->at_stop[line] = -1;
+            break;
+        case SKIBUS_BUS_FINISHED:
+            if (check->at_stop[line] >= 0)
+                violation(check, event, "bus finished at a stop");
+            // the bus only finishes once every skier is done for the day
+            for (int idL = 0; idL < check->c->L; idL++) {
+                if (check->laps[idL] != check->c->laps) {
+                    violation(check, event, "bus finished before every skier was done");
+                    break;
+                }
+            }
+            check->finished[line] = true;
+            check->counts[6]++;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Checks an event of a skier.
+ */
+static void check_skier(checker *check, const skibus_event *event) {
+    int idL = event->skier - 1;
+
+    if (idL < 0 || idL >= check->c->L || event->bus != 0) {
+        violation(check, event, "unknown skier");
+        return;
+    }
+
+    skier_seen *seen = &check->skiers[idL];
+    switch (event->type) {
+        case SKIBUS_SKIER_STARTED:
+            if (*seen != SEEN_NONE)
+                violation(check, event, "skier started twice");
+            *seen = SEEN_WALKING;
+            check->counts[0]++;
+            break;
+        case SKIBUS_SKIER_ARRIVED:
+            if (*seen != SEEN_WALKING)
+                violation(check, event, "skier arrived without walking to the stop");
+            *seen = SEEN_WAITING;
+            check->counts[1]++;
+            break;
+        case SKIBUS_SKIER_BOARDING:
+            if (*seen != SEEN_WAITING)
+                violation(check, event, "skier boarded without waiting at a stop");
+            if (event->stop == 0 || !bus_at(check, event->stop, false))
+                violation(check, event, "skier boarded with no bus at the stop");
+            if (check->c->line_count == 0 && ++check->on_board > bus_capacity(check->c))
+                violation(check, event, "bus over its capacity");
+            *seen = SEEN_RIDING;
+            check->counts[2]++;
+            break;
+        case SKIBUS_SKIER_TRANSFERRING:
+            if (*seen != SEEN_RIDING)
+                violation(check, event, "skier got off without riding");
+            if (!bus_at(check, event->stop, false) && !bus_at(check, event->stop, true))
+                violation(check, event, "skier got off with no bus at the stop");
+            *seen = SEEN_WAITING;
+            check->counts[3]++;
+            break;
+        case SKIBUS_SKIER_SKI:
+            if (*seen != SEEN_RIDING)
+                violation(check, event, "skier went to ski without riding");
+            if (!bus_at_lift(check) || (!bus_at(check, event->stop, false) && !bus_at(check, event->stop, true)))
+                violation(check, event, "skier went to ski with no bus at its lift");
+            if (check->c->line_count == 0)
+                check->on_board--;
+            check->laps[idL]++;
+            *seen = SEEN_WALKING;
+            check->counts[4]++;
+            break;
+        default:
+            break;
+    }
+
+    // a start has no stop
+    int kind = event->type - SKIBUS_SKIER_ARRIVED;
+    if (kind >= 0 && kind < STOP_KINDS && event->stop >= 1 && event->stop <= SKIBUS_MAX_STOPS)
+        check->stop_counts[kind][event->stop]++;
+}
+
+/**
+ * @brief Event callback, checks every event in order.
+ */
+static void check_event(const skibus_event *event, void *user) {
+    checker *check = user;
+
+    if (event->id != check->next_id)
+        violation(check, event, "event IDs are not consecutive");
+    check->next_id = event->id + 1;
+    check->events++;
+
+    if (event->type <= SKIBUS_BUS_FINISHED)
+        check_bus(check, event);
+    else
+        check_skier(check, event);
+}
+
+/**
+ * @brief Checks the end of a run, every bus finished and every skier did all its laps.
+ */
+static void check_end(checker *check) {
+    int lines = check->c->line_count == 0 ? 1 : check->c->line_count;
+
+    for (int line = 0; line < lines; line++) {
+        if (!check->finished[line] && check->violations++ < MAX_REPORTED)
+            fprintf(stderr, "  %s: bus %d never finished\n", check->c->name, line + 1);
+    }
+    for (int idL = 0; idL < check->c->L; idL++) {
+        if (check->laps[idL] != check->c->laps && check->violations++ < MAX_REPORTED)
+            fprintf(stderr, "  %s: skier %d went to ski %d times instead of %ld\n", check->c->name, idL + 1, check->laps[idL], check->c->laps);
+    }
+}
+
+/**
+ * @brief Orders doubles, for the medians.
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Returns the median of the samples, sorts them.
+ */
+static double median(double *samples, int n) {
+    qsort(samples, n, sizeof(double), compare_doubles);
+    return n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
+
+/**
+ * @brief Returns the median absolute deviation of the samples from their median.
+ */
+static double mad(const double *samples, int n, double center) {
+    double deviations[n];
+
+    for (int i = 0; i < n; i++)
+        deviations[i] = fabs(samples[i] - center);
+    return median(deviations, n);
+}
+
+/**
+ * @brief Returns the kind of a count per stop by its name in the goldens, -1 if it is none.
+ */
+static int stop_kind(const char *name) {
+    for (int kind = 0; kind < STOP_KINDS; kind++) {
+        if (strcmp(count_names[kind + 1], name) == 0)
+            return kind;
+    }
+    return -1;
+}
+
+/**
+ * @brief Reads the golden counts per stop of one kind of a case, given as stop:count pairs.
+ */
+static void load_stop_counts(case_reference *refs, const char *name, int kind, const char *pairs) {
+    size_t cases = sizeof(corpus) / sizeof(corpus[0]);
+
+    for (size_t i = 0; i < cases; i++) {
+        if (strcmp(corpus[i].name, name) != 0)
+            continue;
+
+        const char *text = pairs;
+        int stop, used;
+        long long count;
+        refs[i].have_stops = true;
+        while (sscanf(text, " %d:%lld%n", &stop, &count, &used) == 2) {
+            if (stop >= 1 && stop <= SKIBUS_MAX_STOPS)
+                refs[i].golden_stops[kind][stop] = count;
+            text += used;
+        }
+    }
+}
+
+/**
+ * @brief Reads the goldens and the baseline of the corpus, missing files leave the cases without them.
+ * @param dir The regression directory.
+ * @param refs Filled with the references of the cases.
+ * @param host Filled with the host the baseline was taken on, empty if it does not say.
+ */
+static void load_references(const char *dir, case_reference *refs, char host[MAX_HOST]) {
+    char path[512], line[2048], name[64], kind_name[32];
+    size_t cases = sizeof(corpus) / sizeof(corpus[0]);
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s/golden.txt", dir);
+    if ((file = fopen(path, "r")) != NULL) {
+        while (fgets(line, sizeof(line), file) != NULL) {
+            long long c[GOLDEN_COUNTS];
+            int kind, used;
+
+            // a line per stop kind follows the totals: case kind stop:count ...
+            if (line[0] != '#' && sscanf(line, "%63s %31s%n", name, kind_name, &used) == 2 &&
+                (kind = stop_kind(kind_name)) >= 0) {
+                load_stop_counts(refs, name, kind, line + used);
+                continue;
+            }
+            if (line[0] == '#' || sscanf(line, "%63s %lld %lld %lld %lld %lld %lld %lld", name,
+                    &c[0], &c[1], &c[2], &c[3], &c[4], &c[5], &c[6]) != GOLDEN_COUNTS + 1)
+                continue;
+            for (size_t i = 0; i < cases; i++) {
+                if (strcmp(corpus[i].name, name) == 0) {
+                    memcpy(refs[i].golden, c, sizeof(c));
+                    refs[i].have_golden = true;
+                }
+            }
+        }
+        fclose(file);
+    }
+
+    host[0] = '\0';
+    snprintf(path, sizeof(path), "%s/baseline.txt", dir);
+    if ((file = fopen(path, "r")) != NULL) {
+        while (fgets(line, sizeof(line), file) != NULL) {
+            double wall, wall_mad, rate, rate_mad;
+            if (sscanf(line, "# host %63s", name) == 1)
+                snprintf(host, MAX_HOST, "%s", name);
+            if (line[0] == '#' || sscanf(line, "%63s %lf %lf %lf %lf", name, &wall, &wall_mad, &rate, &rate_mad) != 5)
+                continue;
+            for (size_t i = 0; i < cases; i++) {
+                if (strcmp(corpus[i].name, name) == 0) {
+                    refs[i].have_baseline = true;
+                    refs[i].wall = wall;
+                    refs[i].wall_mad = wall_mad;
+                    refs[i].rate = rate;
+                    refs[i].rate_mad = rate_mad;
+                }
+            }
+        }
+        fclose(file);
+    }
+}
+
+/**
+ * @brief Writes the goldens and the baseline of the corpus.
+ * @param dir The regression directory.
+ * @param refs The references of the cases.
+ * @param host The host the baseline was taken on.
+ * @return 0 on success, -1 if a file could not be written.
+ */
+static int save_references(const char *dir, const case_reference *refs, const char *host) {
+    char path[512];
+    size_t cases = sizeof(corpus) / sizeof(corpus[0]);
+
+    snprintf(path, sizeof(path), "%s/golden.txt", dir);
+    FILE *golden = fopen(path, "w");
+    snprintf(path, sizeof(path), "%s/baseline.txt", dir);
+    FILE *baseline = fopen(path, "w");
+    if (golden == NULL || baseline == NULL) {
+        if (golden != NULL)
+            fclose(golden);
+        if (baseline != NULL)
+            fclose(baseline);
+        return -1;
+    }
+
+    fprintf(golden, "# case");
+    for (int i = 0; i < GOLDEN_COUNTS; i++)
+        fprintf(golden, " %s", count_names[i]);
+    fprintf(golden, "\n");
+    // the times are in units of the calibration, only comparable on the same host
+    fprintf(baseline, "# host %s\n", host);
+    fprintf(baseline, "# case wall wall_mad events_per_unit events_per_unit_mad\n");
+
+    for (size_t i = 0; i < cases; i++) {
+        fprintf(golden, "%s", corpus[i].name);
+        for (int j = 0; j < GOLDEN_COUNTS; j++)
+            fprintf(golden, " %lld", refs[i].golden[j]);
+        fprintf(golden, "\n");
+        fprintf(baseline, "%s %.4f %.4f %.2f %.2f\n", corpus[i].name, refs[i].wall, refs[i].wall_mad, refs[i].rate, refs[i].rate_mad);
+    }
+
+    // only the stops with events are listed
+    fprintf(golden, "# case event stop:count ...\n");
+    for (size_t i = 0; i < cases; i++) {
+        for (int kind = 0; kind < STOP_KINDS; kind++) {
+            fprintf(golden, "%s %s", corpus[i].name, count_names[kind + 1]);
+            for (int stop = 1; stop <= SKIBUS_MAX_STOPS; stop++) {
+                if (refs[i].golden_stops[kind][stop] != 0)
+                    fprintf(golden, " %d:%lld", stop, refs[i].golden_stops[kind][stop]);
+            }
+            fprintf(golden, "\n");
+        }
+    }
+
+    bool ok = fclose(golden) == 0;
+    return fclose(baseline) == 0 && ok ? 0 : -1;
+}
+
+/**
+ * @brief Main function.
+ * @param argc The amount of arguments.
+ * @param argv The arguments.
+ * @return The exit status, 1 on any regression.
+*/
+int main(int argc, char *argv[]) {
+    bool update = false;
+    int repeats = DEFAULT_REPEATS;
+    double tolerance = DEFAULT_TOLERANCE;
+    const char *dir = "regress";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+            repeats = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = strtod(argv[++i], NULL);
+        } else if (argv[i][0] != '-') {
+            dir = argv[i];
+        } else {
+            repeats = 0;
+        }
+    }
+    if (repeats < 1 || repeats > MAX_REPEATS || tolerance < 0) {
+        printf("Usage: ./ski-bus-regress [--update] [--repeats N] [--tolerance F] [DIR]\n");
+        return 1;
+    }
+
+    size_t cases = sizeof(corpus) / sizeof(corpus[0]);
+    case_reference refs[cases];
+    char host[MAX_HOST] = "", baseline_host[MAX_HOST];
+    memset(refs, 0, sizeof(refs));
+    load_references(dir, refs, baseline_host);
+
+    // the units of the calibration differ a bit between hosts, so a slowdown elsewhere is only reported
+    if (gethostname(host, sizeof(host)) < 0)
+        host[0] = '\0';
+    host[MAX_HOST - 1] = '\0';
+    bool same_host = host[0] != '\0' && strcmp(host, baseline_host) == 0;
+    if (!update && !same_host)
+        printf("the baseline was taken on %s, not on %s, slowdowns do not fail\n\n",
+            baseline_host[0] != '\0' ? baseline_host : "an unknown host", host);
+
+    skibus_context *ctx = skibus_create();
+    checker *check = malloc(sizeof(checker));
+    if (ctx == NULL || check == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    int failures = 0;
+    printf("%-15s %8s %9s %9s %7s %7s %11s %9s  %s\n", "case", "events", "wall ms", "unit ms", "units", "base", "events/unit", "base", "result");
+
+    for (size_t i = 0; i < cases; i++) {
+        const regress_case *c = &corpus[i];
+        skibus_config config;
+        skibus_default_config(&config);
+        config.L = c->L;
+        config.Z = c->Z;
+        config.K = c->K;
+        config.TL = c->TL;
+        config.TB = c->TB;
+        config.laps = c->laps;
+        config.time_scale = c->time_scale;
+        config.arrival_profile = c->arrivals;
+        config.wait_strategy = c->wait;
+        config.skier_mode = c->skiers;
+        config.seed = c->seed;
+        config.line_count = c->line_count;
+        memcpy(config.lines, c->lines, sizeof(c->lines));
+        memcpy(config.capacities, c->capacities, sizeof(c->capacities));
+        config.segment_count = c->segment_count;
+        memcpy(config.segments, c->segments, sizeof(c->segments));
+
+        // the unit of the case is measured between its runs, under the same load of the host
+        double calibrations[CALIBRATION_RUNS + MAX_REPEATS];
+        int calibrated = 0;
+        while (calibrated < CALIBRATION_RUNS) {
+            if ((calibrations[calibrated++] = calibration_run()) < 0) {
+                perror("failed to run the calibration");
+                return 1;
+            }
+        }
+
+        skibus_callbacks callbacks = { .event = check_event, .user = check };
+        double walls[MAX_REPEATS], rates[MAX_REPEATS], timed_us = 0;
+        long long timed_events[MAX_REPEATS];
+        int timed = 0;
+        long long events = 0;
+        bool failed = false;
+
+        // the first run only warms up the caches and the allocator and is not timed, short
+        // cases are repeated until their timed runs take long enough to be measured
+        for (int r = 0; timed < MAX_REPEATS && (r == 0 || timed < repeats || (timed_us < MIN_CASE_US && !failed)); r++) {
+            if (r > 0 && (calibrations[calibrated++] = calibration_run()) < 0) {
+                perror("failed to run the calibration");
+                return 1;
+            }
+
+            memset(check, 0, sizeof(checker));
+            check->c = c;
+            check->next_id = 1;
+            for (int line = 0; line < SKIBUS_MAX_LINES; line++)
+                check->at_stop[line] = -1;
+
+            double start = now_us();
+            if (skibus_run(ctx, &config, &callbacks) < 0) {
+                fprintf(stderr, "  %s: the run failed: %s\n", c->name, skibus_error(ctx));
+                check->violations++;
+            }
+            double wall_us = now_us() - start;
+            if (r > 0) {
+                walls[timed] = wall_us;
+                timed_events[timed] = check->events;
+                timed_us += wall_us;
+                timed++;
+            }
+            events = check->events;
+
+            check_end(check);
+
+            // the skier events only depend on the seed, the bus laps on the timing
+            if (update && r == 0) {
+                memcpy(refs[i].golden, check->counts, sizeof(check->counts));
+                memcpy(refs[i].golden_stops, check->stop_counts, sizeof(check->stop_counts));
+                refs[i].have_golden = refs[i].have_stops = true;
+            } else if (!refs[i].have_golden || !refs[i].have_stops) {
+                fprintf(stderr, "  %s: no golden counts, run with --update\n", c->name);
+                check->violations++;
+            } else {
+                for (int j = 0; j < GOLDEN_COUNTS; j++) {
+                    if (check->counts[j] != refs[i].golden[j] && check->violations++ < MAX_REPORTED)
+                        fprintf(stderr, "  %s: %lld %s events, the golden has %lld\n", c->name, check->counts[j], count_names[j], refs[i].golden[j]);
+                }
+                for (int kind = 0; kind < STOP_KINDS; kind++) {
+                    for (int stop = 1; stop <= SKIBUS_MAX_STOPS; stop++) {
+                        long long count = check->stop_counts[kind][stop], golden = refs[i].golden_stops[kind][stop];
+                        if (count != golden && check->violations++ < MAX_REPORTED)
+                            fprintf(stderr, "  %s: %lld %s events at stop %d, the golden has %lld\n", c->name, count, count_names[kind + 1], stop, golden);
+                    }
+                }
+            }
+
+            if (check->violations > 0) {
+                fprintf(stderr, "  %s: run %d broke the log in %d places\n", c->name, r + 1, check->violations);
+                failed = true;
+            }
+        }
+
+        double unit_us = median(calibrations, calibrated);
+        for (int r = 0; r < timed; r++) {
+            walls[r] /= unit_us;
+            rates[r] = timed_events[r] / walls[r];
+        }
+
+        double wall = median(walls, timed), wall_mad = mad(walls, timed, wall);
+        double rate = median(rates, timed), rate_mad = mad(rates, timed, rate);
+        const char *result = failed ? "FAIL (log)" : "ok";
+
+        if (update) {
+            refs[i].wall = wall;
+            refs[i].wall_mad = wall_mad;
+            refs[i].rate = rate;
+            refs[i].rate_mad = rate_mad;
+            refs[i].have_baseline = true;
+            result = failed ? "FAIL (log), updated" : "updated";
+        } else if (!refs[i].have_baseline) {
+            fprintf(stderr, "  %s: no baseline, run with --update\n", c->name);
+            result = "FAIL (no baseline)";
+            failed = true;
+        } else if (!failed) {
+            // relative noise of both sides on top of the tolerance
+            double wall_noise = NOISE_MADS * (wall_mad / wall + refs[i].wall_mad / refs[i].wall);
+            double rate_noise = NOISE_MADS * (rate_mad / rate + refs[i].rate_mad / refs[i].rate);
+
+            if (wall > refs[i].wall * (1 + tolerance + wall_noise)) {
+                result = same_host ? "FAIL (slower)" : "slower (other host)";
+                failed = same_host;
+            } else if (rate < refs[i].rate * (1 - tolerance - rate_noise)) {
+                result = same_host ? "FAIL (events/s)" : "fewer events/s (other host)";
+                failed = same_host;
+            }
+        }
+
+        printf("%-15s %8lld %9.1f %9.2f %7.2f %7.2f %11.1f %9.1f  %s\n", c->name, events, wall * unit_us / 1e3,
+            unit_us / 1e3, wall, refs[i].wall, rate, refs[i].rate, result);
+        fflush(stdout);
+        failures += failed;
+    }
+
+    free(check);
+    skibus_destroy(ctx);
+
+    // a broken tree never becomes the reference
+    if (update && failures == 0 && save_references(dir, refs, host) < 0) {
+        perror("failed to write the goldens");
+        return 1;
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "\nREGRESSION: %d of %zu cases failed\n", failures, cases);
+        return 1;
+    }
+    printf("\nall %zu cases passed\n", cases);
+    return 0;
+}
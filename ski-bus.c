@@ -4,7 +4,7 @@ _______________________________
  * Name: Martin Mendl
  * Email: x247581@fit.vutbr.cz
  * Date: 26.4. 2024
- * file: main code src file for ski-bus
+ * file: main code src file for ski-bus, the command line front end of libskibus
 _______________________________
 */
 
@@ -12,754 +12,480 @@ _______________________________
 #include "ski-bus.h"
 
 /**
- * @brief Initializes the bus stops and the semaphore for the final stop.
+ * @brief Cuts the log back to its first lines and carries on writing after them.
+ * @param lines The amount of lines to keep.
+ * @return 0 on success, -1 on failure.
 */
-void init_bus_stops() {
-    bus_stops = mmap(NULL, sizeof(sem_t)*Z, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, 0, 0);
-    bus_stop_sign = mmap(NULL, sizeof(sem_t), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, 0, 0);
-    skiers_waiting = mmap(NULL, sizeof(int)*Z, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, 0, 0);
-    datafor = mmap(NULL, sizeof(sem_t), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, 0, 0);
-    printafor = mmap(NULL, sizeof(sem_t), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, 0, 0);
-
-    // check for errors
-    if (
-        bus_stops == MAP_FAILED ||
-        bus_stop_sign == MAP_FAILED || 
-        skiers_waiting == MAP_FAILED || 
-        datafor == MAP_FAILED ||
-        printafor == MAP_FAILED
-        ) {
-
-        perror("mapping of semaphores failed!\n");
-        exit(EXIT_FAILURE);
-    }
-
-    // Initialize the semaphores for the bus stops
-    for (int i = 0; i < Z; i++) {
-        if (sem_init(&bus_stops[i], 1, 1) < 0) {
-            perror("sem_init failed");
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    // Initialize the semaphore for the bus stop sign
-    if (sem_init(bus_stop_sign, 1, 1) < 0) { 
-        perror("faild to init bus_stop_sign");
-        exit(EXIT_FAILURE);
-    }
+int truncate_log(int lines) {
+    long offset = 0;
+    int c;
 
-    // Initialize the semaphore for the shared data
-    if (sem_init(datafor, 1, 1) < 0){
-        perror("faild to inif datafor");
-        exit(EXIT_FAILURE);
+    rewind(out_file);
+    while (lines > 0 && (c = fgetc(out_file)) != EOF) {
+        offset++;
+        if (c == '\n')
+            lines--;
     }
 
-    // Initialize the semaphore for the print
-    if (sem_init(printafor, 1, 1) < 0){
-        perror("faild to inif printafor");
-        exit(EXIT_FAILURE);
-    }
+    if (fflush(out_file) != 0 || ftruncate(fileno(out_file), offset) < 0 || fseek(out_file, 0, SEEK_END) < 0)
+        return -1;
+    return 0;
 }
 
 /**
- * @brief Destroys the bus stops and the semaphore for the final stop.
+ * @brief Prints an event to stdout and to the output file, with --timestamps after its model
+ * time in seconds. A restored run has printed the events up to the checkpoint already, its
+ * first event says how many.
+ * @param event The event.
+ * @param user Unused.
 */
-void destroy_bus_stops() {
-    for (int i = 0; i < Z; i++) {
-        if (sem_destroy(&bus_stops[i]) < 0) {
-            perror("sem_destroy");
-            exit(EXIT_FAILURE);
-        }
-    }
-    // Unmap the memory region
-    if (munmap(bus_stops, sizeof(sem_t)*Z) < 0) {
-        perror("munmap");
-        exit(EXIT_FAILURE);
-    }
+void print_event(const skibus_event *event, void *user) {
+    (void)user;
+    char line[128], stamp[32] = "";
 
-    // Unmap the semaphore, for skier waiting for the bus to finish
-    if (munmap(bus_stop_sign ,sizeof(sem_t)) < 0) {
-        perror("munmap");
-        exit(EXIT_FAILURE);
+    if (truncate_pending) {
+        truncate_pending = false;
+        // drop the log lines written after the checkpoint
+        if (truncate_log(event->id - 1) < 0)
+            perror("failed to rewind the log file");
     }
 
-    if (munmap(datafor, sizeof(sem_t)) < 0) {
-        perror("munmap");
-        exit(EXIT_FAILURE);
-    }
+    int length = skibus_format_event(event, line, sizeof(line));
+    if (show_timestamps)
+        length += snprintf(stamp, sizeof(stamp), "%14.6f s  ", event->model_time_us / 1e6);
 
-    if (munmap(printafor, sizeof(sem_t)) < 0) {
-        perror("munmap");
-        exit(EXIT_FAILURE);
+    printf("%s%s\n", stamp, line);
+    if (out_file != NULL) {
+        fprintf(out_file, "%s%s\n", stamp, line);
+        index_event(event, out_file_offset);
+        out_file_offset += length + 1;
     }
 }
 
 /**
- * @brief Initializes the shared memory.
+ * @brief Adds an event to the index of the output file. The index is kept in memory and
+ * saved once the output file is complete.
+ * @param event The event.
+ * @param offset The offset of the line of the event in the output file.
 */
-void init_shared_memory() {
-
-    shared_memory = mmap(NULL, sizeof(shared_data), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, 0, 0);
-
-    if (shared_memory == MAP_FAILED) {
-        perror("mapping shared data failed\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+void index_event(const skibus_event *event, long long offset) {
+    if (log_index != NULL && skibus_index_add(log_index, event, offset) < 0) {
+        fprintf(stderr, "failed to index the log, no index is written\n");
+        skibus_index_destroy(log_index);
+        log_index = NULL;
     }
-
-    shared_memory->skiers_boarded = 0;
-    shared_memory->occupancy = 0;
-    shared_memory->amount_of_skiers_to_board = 0;
-    shared_memory->out_file = fopen(out_file_name, "w"); // Open the file for writing
 }
 
 /**
- * @brief Waits for the shared data to be available.
+ * @brief Makes the output file end exactly at the checkpoint.
+ * @param user Unused.
 */
-void wait_for_my_turn() {
-
-    if (sem_wait(datafor) < 0) {
-        perror("datafor faild to load\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
+void flush_log(void *user) {
+    (void)user;
+    if (out_file != NULL)
+        fflush(out_file);
 }
 
 /**
- * @brief Frees the shared data.
+ * @brief Keeps the statistics of the finished run.
+ * @param stats The statistics.
+ * @param user Unused.
 */
-void done_with_my_turn() {
-    if (sem_post(datafor) < 0) {
-        perror("datafor faild to free\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
+void keep_statistics(const skibus_stats *stats, void *user) {
+    (void)user;
+    run_stats = *stats;
 }
 
 /**
- * @brief Destroys the shared memory.
+ * @brief Prints the run statistics, all times are in model time.
 */
-void destroy_shared_memory() {
-    // Unmap the shared memory region
-    if (munmap(shared_memory, sizeof(shared_data)) < 0) {
-        perror("munmap");
-        exit(EXIT_FAILURE);
-    }
+void print_statistics() {
+    skibus_stats *stats = &run_stats;
+
+    fprintf(stderr, "time scale: %g\n", stats->time_scale);
+    fprintf(stderr, "events: %d\n", stats->events);
+    fprintf(stderr, "skiers transported: %d\n", stats->skiers_transported);
+    fprintf(stderr, "model time (scaled wall clock): %.3f s\n", stats->model_time_us / 1e6);
+    fprintf(stderr, "bus travel time (all lines): %.3f s\n", stats->bus_travel_us / 1e6);
+    fprintf(stderr, "bus utilization: %.1f %%\n", 100.0 * stats->bus_utilization);
+
+    if (stats->steady_throughput >= 0)
+        fprintf(stderr, "steady state throughput: %.3f skiers/s\n", stats->steady_throughput);
+    else
+        fprintf(stderr, "steady state throughput: n/a (needs --laps 3 or more, or --duration)\n");
+
+    fprintf(stderr, "boarding wait (model): p50 <= %lld us, p99 <= %lld us, max %lld us\n",
+        stats->wait_p50_us, stats->wait_p99_us, stats->wait_max_us);
+    fprintf(stderr, "wait strategy: %s\n", wait_strategy_names[stats->wait_strategy]);
+    if (stats->wait_strategy == SKIBUS_WAIT_ADAPTIVE)
+        fprintf(stderr, "handshake waits: %lld spun, %lld blocked\n", stats->spin_hits, stats->spin_blocks);
+    fprintf(stderr, "mean stop handoff (real): %.2f us over %lld handoffs\n",
+        stats->handoffs > 0 ? stats->handoff_ns / 1e3 / stats->handoffs : 0.0, stats->handoffs);
+    fprintf(stderr, "real time: %.3f s\n", stats->real_time_us / 1e6);
 }
 
 /**
- * @brief add a message to the log buffer
- * 
- * @param message The message to be added to the log buffer
+ * @brief Prints the memory of the run to stderr.
 */
-void add_log_message(const char *message) {
-    if (shared_memory->num_messages < MAX_LOG_MESSAGES) {
-        strncpy(shared_memory->log_messages[shared_memory->num_messages], message, MAX_MESSAGE_LENGTH - 1);
-        shared_memory->log_messages[shared_memory->num_messages][MAX_MESSAGE_LENGTH - 1] = '\0'; // Ensure null termination
-        shared_memory->num_messages++;
-    }
-
-    if (shared_memory->num_messages == MAX_LOG_MESSAGES) 
-        write_logs_to_file();
+void print_memory_statistics() {
+    skibus_stats *stats = &run_stats;
+
+    fprintf(stderr, "skier workers: %d (%s)\n", stats->skier_workers, skier_mode_names[stats->skier_mode]);
+    fprintf(stderr, "shared memory: %lld KiB, %s pages\n", stats->arena_kb, page_backing_names[stats->page_backing]);
+    fprintf(stderr, "peak rss (shared pages counted per process): %lld KiB\n", stats->peak_rss_kb);
+    fprintf(stderr, "peak pss: %lld KiB, %lld KiB before the skiers\n", stats->peak_pss_kb, stats->base_pss_kb);
+    fprintf(stderr, "peak kernel stacks and page tables (system): %lld KiB, %lld KiB before the skiers\n",
+        stats->peak_kernel_kb, stats->base_kernel_kb);
+    fprintf(stderr, "memory per skier: %.1f KiB\n", stats->memory_per_skier_kb);
 }
 
 /**
- * @brief Write the log messages to the output file.
+ * @brief Prints the trips and the stops of every line to stderr. The load is the share of the
+ * seats taken when leaving the stop, the dwell runs from arriving to leaving, in model time.
 */
-void write_logs_to_file() {
-    if (shared_memory->out_file != NULL) {
-        for (int i = 0; i < shared_memory->num_messages; i++) {
-            fprintf(shared_memory->out_file, "%s\n", shared_memory->log_messages[i]);
-            // Clear the message from the buffer
-            shared_memory->log_messages[i][0] = '\0';
+void print_report() {
+    skibus_stats *stats = &run_stats;
+
+    for (int line = 0; line < stats->line_count; line++) {
+        skibus_line_stats *report = &stats->lines[line];
+        long long trips = report->trips > 0 ? report->trips : 1;
+
+        fprintf(stderr, "line %d: %lld trips, mean trip %.3f s, mean peak load %.1f/%d, %lld full, %lld left skiers behind\n",
+            line + 1, report->trips, report->trip_us / 1e6 / trips, (double)report->peak_load_sum / trips,
+            report->capacity, report->full_trips, report->left_behind_trips);
+        fprintf(stderr, "  %4s %8s %6s %8s %8s %6s %6s %4s %10s\n",
+            "stop", "visits", "empty", "boarded", "alighted", "left", "load", "max", "dwell ms");
+
+        for (int i = 0; i < report->length; i++) {
+            skibus_stop_stats *stop = &report->stops[i];
+            long long visits = stop->visits > 0 ? stop->visits : 1;
+
+            fprintf(stderr, "  %4d %8lld %5.1f%% %8lld %8lld %6lld %5.1f%% %4d %10.3f\n",
+                stop->stop, stop->visits, 100.0 * stop->empty_visits / visits, stop->boarded, stop->alighted,
+                stop->left_behind, 100.0 * stop->load_sum / visits / report->capacity, stop->max_load,
+                stop->dwell_us / 1e3 / visits);
         }
-        fflush(shared_memory->out_file); // Ensure data is written immediately
-        shared_memory->num_messages = 0;
     }
 }
 
-
 /**
- * @brief Generates a random sleep time.
+ * @brief Writes a row per stop of every line as CSV, the trips of the line are repeated on every row.
+ * @param file_name The CSV file.
+ * @return 0 on success, -1 if the file could not be written.
 */
-void random_sleep(int max_value) {
-    srand(getpid() + time(NULL));
-    float sleep_time =  rand() % (max_value + 1);
-    usleep(sleep_time);
-}
-
-/**
- * @brief Prints out the message that the bus has started.
-*/
-void bus_started() {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+int write_report_csv(const char *file_name) {
+    skibus_stats *stats = &run_stats;
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL)
+        return -1;
+
+    fprintf(file, "line,position,stop,visits,empty_visits,boarded,alighted,left_behind,mean_load,max_load,mean_dwell_us,"
+        "trips,mean_trip_us,mean_peak_load,full_trips,left_behind_trips,capacity\n");
+
+    for (int line = 0; line < stats->line_count; line++) {
+        skibus_line_stats *report = &stats->lines[line];
+        long long trips = report->trips > 0 ? report->trips : 1;
+
+        for (int i = 0; i < report->length; i++) {
+            skibus_stop_stats *stop = &report->stops[i];
+            long long visits = stop->visits > 0 ? stop->visits : 1;
+
+            fprintf(file, "%d,%d,%d,%lld,%lld,%lld,%lld,%lld,%.3f,%d,%.1f,%lld,%.1f,%.3f,%lld,%lld,%d\n",
+                line + 1, i + 1, stop->stop, stop->visits, stop->empty_visits, stop->boarded, stop->alighted,
+                stop->left_behind, (double)stop->load_sum / visits, stop->max_load, (double)stop->dwell_us / visits,
+                report->trips, (double)report->trip_us / trips, (double)report->peak_load_sum / trips,
+                report->full_trips, report->left_behind_trips, report->capacity);
+        }
     }
-    shared_memory->ID++;
-
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: BUS: started", shared_memory->ID);
 
-    printf("%s\n", log_message);
-    add_log_message(log_message);
-
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
+    return fclose(file) == 0 ? 0 : -1;
 }
 
 /**
- * @brief Prints out the message that the bus has arrived at a bus stop.
- * @param idZ The ID of the bus stop.
+ * @brief Asks the running simulation for a checkpoint.
+ * @param sig The signal number.
 */
-void bus_arrived(int idZ) {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-    shared_memory->ID++;
-
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: BUS: arrived to %d", shared_memory->ID, idZ);
-
-    printf("%s\n", log_message);
-    add_log_message(log_message);
-
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
+void request_checkpoint(int sig) {
+    (void)sig;
+    if (context != NULL)
+        skibus_request_checkpoint(context);
 }
 
 /**
- * @brief Prints out the message that the bus has left a bus stop.
- * @param idZ The ID of the bus stop.
+ * @brief Prints the usage of the program.
 */
-void bus_leaving(int idZ) {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-    shared_memory->ID++;
-
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: BUS: leaving %d", shared_memory->ID, idZ);
-
-    printf("%s\n", log_message);
-    add_log_message(log_message);
-
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
+void print_usage() {
+    printf("Usage: ./ski-bus [--time-scale F] [--stats] [--timestamps] [--routes FILE] [--scenario FILE] [--laps N | --duration S] [--arrivals PROFILE] [--wait STRATEGY] [--skiers MODE] [--huge-pages MODE] [--memory-budget KIB] [--report CSV] [--index FILE] [--checkpoint FILE [--checkpoint-interval S]] L Z K TL TB\n"
+           "       ./ski-bus [--stats] [--timestamps] [--wait STRATEGY] [--skiers MODE] [--huge-pages MODE] [--memory-budget KIB] [--report CSV] [--checkpoint FILE [--checkpoint-interval S]] --restore FILE\n"
+           "The steady state throughput of --stats needs --laps 3 or more, or --duration.\n");
 }
 
 /**
- * @brief Prints out the message that the bus has arrived at the final bus stop.
+ * @brief Main function.
+ * @param argc The amount of arguments.
+ * @param argv The arguments.
+ * @return The exit status.
 */
-void bus_arrived_to_final() {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-    shared_memory->ID++;
-
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: BUS: arrived to final", shared_memory->ID);
-
-    printf("%s\n", log_message);
-    add_log_message(log_message);
+int main(int argc, char *argv[]) {
 
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+    static struct option long_options[] = {
+        {"time-scale", required_argument, NULL, 's'},
+        {"stats", no_argument, NULL, 'S'},
+        {"timestamps", no_argument, NULL, 'T'},
+        {"routes", required_argument, NULL, 'r'},
+        {"scenario", required_argument, NULL, 'n'},
+        {"laps", required_argument, NULL, 'l'},
+        {"duration", required_argument, NULL, 'd'},
+        {"arrivals", required_argument, NULL, 'a'},
+        {"checkpoint", required_argument, NULL, 'c'},
+        {"checkpoint-interval", required_argument, NULL, 'i'},
+        {"restore", required_argument, NULL, 'R'},
+        {"wait", required_argument, NULL, 'w'},
+        {"skiers", required_argument, NULL, 'k'},
+        {"huge-pages", required_argument, NULL, 'H'},
+        {"memory-budget", required_argument, NULL, 'm'},
+        {"report", required_argument, NULL, 'p'},
+        {"index", required_argument, NULL, 'x'},
+        {NULL, 0, NULL, 0}
+    };
+
+    skibus_config config;
+    const char *routes_file_name = NULL;
+    const char *scenario_file_name = NULL;
+    char *endptr;
+    int opt;
+
+    skibus_default_config(&config);
+
+    // parse the optional switches, the positional arguments follow
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's':
+                config.time_scale = strtod(optarg, &endptr);
+                if (*endptr != '\0' || config.time_scale < 1) {
+                    printf("Invalid value for --time-scale!\n");
+                    return 1;
+                }
+                break;
+            case 'S':
+                show_statistics = true;
+                break;
+            case 'T':
+                show_timestamps = true;
+                break;
+            case 'r':
+                routes_file_name = optarg;
+                break;
+            case 'n':
+                scenario_file_name = optarg;
+                break;
+            case 'l':
+                config.laps = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || config.laps < 1) {
+                    printf("Invalid value for --laps!\n");
+                    return 1;
+                }
+                break;
+            case 'a':
+                config.arrival_profile = SKIBUS_ARRIVALS_NONE;
+                for (int i = SKIBUS_ARRIVALS_UNIFORM; i <= SKIBUS_ARRIVALS_BURSTY; i++) {
+                    if (strcmp(optarg, arrival_profile_names[i]) == 0)
+                        config.arrival_profile = i;
+                }
+                if (config.arrival_profile == SKIBUS_ARRIVALS_NONE) {
+                    printf("Invalid value for --arrivals!\n");
+                    return 1;
+                }
+                break;
+            case 'd':
+                // given in model seconds
+                config.duration = strtod(optarg, &endptr) * 1e6;
+                if (*endptr != '\0' || config.duration <= 0) {
+                    printf("Invalid value for --duration!\n");
+                    return 1;
+                }
+                break;
+            case 'c':
+                config.checkpoint_file = optarg;
+                break;
+            case 'i':
+                // given in model seconds
+                config.checkpoint_interval = strtod(optarg, &endptr);
+                if (*endptr != '\0' || config.checkpoint_interval <= 0) {
+                    printf("Invalid value for --checkpoint-interval!\n");
+                    return 1;
+                }
+                break;
+            case 'R':
+                config.restore_file = optarg;
+                break;
+            case 'w':
+                if (strcmp(optarg, wait_strategy_names[SKIBUS_WAIT_BLOCK]) == 0) {
+                    config.wait_strategy = SKIBUS_WAIT_BLOCK;
+                } else if (strcmp(optarg, wait_strategy_names[SKIBUS_WAIT_ADAPTIVE]) == 0) {
+                    config.wait_strategy = SKIBUS_WAIT_ADAPTIVE;
+                } else {
+                    printf("Invalid value for --wait!\n");
+                    return 1;
+                }
+                break;
+            case 'k':
+                if (strcmp(optarg, skier_mode_names[SKIBUS_SKIERS_PROCESS]) == 0) {
+                    config.skier_mode = SKIBUS_SKIERS_PROCESS;
+                } else if (strcmp(optarg, skier_mode_names[SKIBUS_SKIERS_CLONE]) == 0) {
+                    config.skier_mode = SKIBUS_SKIERS_CLONE;
+                } else {
+                    printf("Invalid value for --skiers!\n");
+                    return 1;
+                }
+                break;
+            case 'H':
+                config.huge_pages = SKIBUS_PAGES_NORMAL;
+                for (int i = SKIBUS_PAGES_TRANSPARENT; i <= SKIBUS_PAGES_HUGETLB; i++) {
+                    if (strcmp(optarg, page_backing_names[i]) == 0)
+                        config.huge_pages = i;
+                }
+                if (config.huge_pages == SKIBUS_PAGES_NORMAL) {
+                    printf("Invalid value for --huge-pages!\n");
+                    return 1;
+                }
+                break;
+            case 'm':
+                // given in KiB per skier
+                memory_budget_kb = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || memory_budget_kb <= 0) {
+                    printf("Invalid value for --memory-budget!\n");
+                    return 1;
+                }
+                break;
+            case 'p':
+                report_file_name = optarg;
+                break;
+            case 'x':
+                index_file_name = optarg;
+                break;
+            default:
+                print_usage();
+                return 1;
+        }
     }
-}
 
-/**
- * @brief Prints out the message that the bus has left the final bus stop.
-*/
-void bus_leaving_final() {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+    // chekc for amoutn of arguments
+    if (argc - optind != (config.restore_file != NULL ? 0 : 5)) {
+        printf("Invalid number of arguments!\n");
+        print_usage();
+        return 1;
     }
-    shared_memory->ID++;
+    argv += optind - 1;
 
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: BUS: leaving final", shared_memory->ID);
+    if (config.restore_file == NULL) {
+        // the library checks the ranges, only the numbers are checked here
+        long *arguments[] = { &config.L, &config.Z, &config.K, &config.TL, &config.TB };
+        const char *names[] = { "L", "Z", "K", "TL", "TB" };
 
-    printf("%s\n", log_message);
-    add_log_message(log_message);
+        for (int i = 0; i < 5; i++) {
+            *arguments[i] = strtol(argv[i + 1], &endptr, 10);
+            if (*endptr != '\0') {
+                printf("Invalid value for %s!\n", names[i]);
+                return 1;
+            }
+        }
 
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-}
+        if (routes_file_name != NULL && skibus_load_routes(&config, routes_file_name) < 0) {
+            printf("Invalid route network in %s!\n", routes_file_name);
+            return 1;
+        }
 
-/**
- * @brief Prints out the message that the bus has finished its journey.
-*/
-void bus_finished() {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-    shared_memory->ID++;
-
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: BUS: finish", shared_memory->ID);
-    
-    printf("%s\n", log_message);    
-    add_log_message(log_message);
-
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-}
+        if (scenario_file_name != NULL && skibus_load_scenario(&config, scenario_file_name) < 0) {
+            printf("Invalid scenario in %s!\n", scenario_file_name);
+            return 1;
+        }
 
-/**
- * @brief Prints out the message that the skier has started.
- * @param idL The ID of the skier.
-*/
-void skier_started(int idL) {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+        // the cold start ends at ride L and the wind down starts at ride L*(N-1), which is the same ride for 2 laps
+        if (show_statistics && config.duration == 0 && config.laps == 2)
+            fprintf(stderr, "the steady state throughput needs --laps 3 or more, it is not reported\n");
     }
-    shared_memory->ID++;
-
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: L %d: started", shared_memory->ID, idL);
 
-    printf("%s\n", log_message);
-    add_log_message(log_message);
-
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+    // the index covers the whole log, the part before a checkpoint is not seen again
+    if (index_file_name != NULL && config.restore_file != NULL) {
+        printf("--index can not be used with --restore!\n");
+        return 1;
     }
-}
 
-/**
- * @brief Prints out the message that the skier has arrived at a bus stop.
- * @param idL The ID of the skier.
- * @param idZ The ID of the bus stop.
-*/
-void skier_arrived(int idL, int idZ) {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-    shared_memory->ID++;
-
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: L %d: arrived to %d", shared_memory->ID, idL, idZ);
-    
-    printf("%s\n", log_message);
-    add_log_message(log_message);
-
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-}
+    // the memory of the children is only sampled for the statistics or the budget
+    config.sample_memory = show_statistics || memory_budget_kb > 0;
 
-/**
- * @brief Prints out the message that the skier is boarding the bus.
- * @param idL The ID of the skier.
-*/
-void skier_boarding(int idL) {
-    if (sem_wait(printafor) < 0) {
-        perror("faild to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+    context = skibus_create();
+    if (context == NULL) {
+        perror("malloc");
+        return 1;
     }
-    shared_memory->ID++;
 
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: L %d: boarding", shared_memory->ID, idL);
+    // a restored run carries on in the log of the checkpointed one
+    out_file = fopen(out_file_name, config.restore_file != NULL ? "r+" : "w");
+    if (out_file != NULL)
+        setvbuf(out_file, out_file_buffer, _IOFBF, sizeof(out_file_buffer));
+    truncate_pending = config.restore_file != NULL && out_file != NULL;
 
-    printf("%s\n", log_message);    
-    add_log_message(log_message);
-
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * @brief Prints out the message that the skier has reached the sky.
- * @param idL The ID of the skier.
-*/
-void skier_sky(int idL) {
-    if (sem_wait(printafor) < 0) {
-        perror("printafor to display bus started message\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+    if (index_file_name != NULL && (out_file == NULL || (log_index = skibus_index_create()) == NULL)) {
+        printf("Failed to index %s!\n", out_file_name);
+        skibus_destroy(context);
+        if (out_file != NULL)
+            fclose(out_file);
+        return 1;
     }
-    shared_memory->ID++;
-
-    snprintf(log_message, MAX_MESSAGE_LENGTH, "%d: L %d: going to ski", shared_memory->ID, idL);
 
-    printf("%s\n", log_message);
-    add_log_message(log_message);
-
-    if (sem_post(printafor) < 0) {
-        perror("faild to return from showing bus started message");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
+    // checkpoints are asked for by SIGUSR1, the timer runs in the library
+    if (config.checkpoint_file != NULL) {
+        struct sigaction action = { .sa_handler = request_checkpoint };
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, NULL);
     }
-}
-
-/**
- * @brief Creates the skier processes.
-*/
-void create_skiers_processes() {
-
-    int id, data_buffer;
-
-    for (int idL = 0; idL < L; idL++) {
-
-        id = fork();
 
-        if (id < 0) {
-            shared_memory->skiers_boarded = -1;        
-            // let other skiers now, that they should quit as well   
-            destroy_bus_stops();
-            destroy_shared_memory();
-            perror("failed to create a skiier\n");
-            exit(EXIT_FAILURE);
-        } else if (id == 0) {
+    skibus_callbacks callbacks = {
+        .event = print_event,
+        .checkpoint = flush_log,
+        .stats = keep_statistics,
+        .user = NULL,
+    };
 
-            // select a ranodm destion the skier has to go to
-            srand(getpid() + time(NULL)); // seed the random number generator
-            int skier_destionation = rand() % (Z-1); // generate a random number in interval <0, Z-1>
-
-            skier_started(idL+1);
-
-            // wait for the skier to reach the destination
-            random_sleep(TL);
-
-            skier_arrived(idL+1, skier_destionation+1);
-            
-            // take note of how many skiers are present at each bus stop
-            wait_for_my_turn();
-            skiers_waiting[skier_destionation]++;
-            done_with_my_turn();
-
-            // skier needs to wait for the bus stop to become available
-            if (sem_wait(&bus_stops[skier_destionation]) < 0) {
-                perror("skier faild to shop up to the bus stop\n");
-                destroy_bus_stops();
-                destroy_shared_memory();
-                exit(EXIT_FAILURE);
-            }
-
-            // board the bus
-            skier_boarding(idL+1);
-
-            wait_for_my_turn();
-            shared_memory->occupancy++;
-            shared_memory->skiers_boarded++;
-            shared_memory->amount_of_skiers_to_board--;
-            skiers_waiting[skier_destionation]--;
-            data_buffer = shared_memory->amount_of_skiers_to_board;
-            done_with_my_turn();
-
-            // I am the last one to board
-            if (data_buffer == 0) {
-                // tell the bus to leave
-                if (sem_post(bus_stop_sign) < 0) {
-                    perror("bus faild to leave the bus station\n");
-                    destroy_bus_stops();
-                    destroy_shared_memory();
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            // wait for the final stop
-            if (sem_wait(&bus_stops[Z-1]) < 0) {
-                perror("skier fiald to get of the bus at the final stop\n");
-                destroy_bus_stops();
-                destroy_shared_memory();
-                exit(EXIT_FAILURE);
-            }
-
-            skier_sky(idL+1);
-            
-            // leave the bus
-            wait_for_my_turn();
-            shared_memory->occupancy--;
-            data_buffer = shared_memory->occupancy;
-            done_with_my_turn();
-
-            // I am the last sub process
-            if (data_buffer == 0) {
-
-                // tell the bus to leave
-                if (sem_post(bus_stop_sign) < 0) {
-                    perror("bus faild to leave the bus station\n");
-                    destroy_bus_stops();
-                    destroy_shared_memory();
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            exit(EXIT_SUCCESS);
-        }
+    if (skibus_run(context, &config, &callbacks) < 0) {
+        printf("%s!\n", skibus_error(context));
+        skibus_destroy(context);
+        skibus_index_destroy(log_index);
+        if (out_file != NULL)
+            fclose(out_file);
+        return 1;
     }
-}
-
-/**
- * @brief Creates the ski bus process.
-*/
-void craete_ski_bus_process() {
-
-    int id = fork();
-
-    if (id < 0) {
-        perror("failed to create ski bus process!\n");
-        destroy_bus_stops();
-        destroy_shared_memory();
-        exit(EXIT_FAILURE);
-    } else if (id == 0) {
-        
-        // making all the bus stops unawailable
-        for (int i = 0; i < Z; i++) {
-            if (sem_wait(&bus_stops[i]) < 0) {  
-                perror("failed to aquarie a bus stop\n");
-                destroy_bus_stops();
-                destroy_shared_memory();
-                exit(EXIT_FAILURE);
-            }
-        }
-
-        // create skiner processes
-        create_skiers_processes();
-
-        // move to the first bus stop
-        int amount_of_skiers_to_board, available_space;
-
-        bus_started();
-
-        while (1) {
-            
-            for (int idZ = 0; idZ < Z-1; idZ++) {
-
-                // travel to bus stop
-                random_sleep(TB);
-                bus_arrived(idZ+1);
-
-                wait_for_my_turn();
-                // Calculate the available space on the bus
-                available_space = K - shared_memory->occupancy;
-
-                // amount of peopole that will board the bus
-                amount_of_skiers_to_board =  skiers_waiting[idZ] >= available_space ? available_space : skiers_waiting[idZ];
-
-                // tell the skiers, how many can baord the bus
-                shared_memory->amount_of_skiers_to_board = amount_of_skiers_to_board;
-                done_with_my_turn();
-
-                // the value of the semaphore is -1 at this point
-                if (amount_of_skiers_to_board > 0) {
-                    
-                    // make the bus stop sign active
-                    if (sem_wait(bus_stop_sign) < 0) {
-                        perror("Bus faild to wait for skiers to baord\n");
-                        destroy_bus_stops();
-                        destroy_shared_memory();
-                        exit(EXIT_FAILURE);
-                    }
-
-                    // allow n amount of passages to board                
-                    for (int j = 0; j < amount_of_skiers_to_board; j++) {
-                        if (sem_post(&bus_stops[idZ]) < 0) {
-                            perror("faild to make space on the bus!\n");
-                            destroy_bus_stops();
-                            destroy_shared_memory();
-                            exit(EXIT_FAILURE);
-                        }
-                    }
-
-                    // the only way this will go throw, is when the last skier would free the bus_stop_sign
-                    // this means, that the last skier has boarded
-                    if (sem_wait(bus_stop_sign) < 0) {
-                        perror("Bus faild to wait for skiers to baord\n");
-                        destroy_bus_stops();
-                        destroy_shared_memory();
-                        exit(EXIT_FAILURE);
-                    }
-
-                    // free the stop sign
-                    if (sem_post(bus_stop_sign) < 0) {
-                        perror("bus faild to leave the bus station\n");
-                        destroy_bus_stops();
-                        destroy_shared_memory();
-                        exit(EXIT_FAILURE);
-                    }
-                }
-
-                bus_leaving(idZ+1);
-            }
-
-            // travel to final bus stop
-            random_sleep(TB);
-
-            bus_arrived_to_final();
-
-            wait_for_my_turn();
-            int amount_of_pasagers = shared_memory->occupancy;
-            done_with_my_turn();
-
-            if ( amount_of_pasagers > 0) {
-                
-                // make the bus stop sign active
-                if (sem_wait(bus_stop_sign) < 0) {
-                    perror("Bus faild to wait for skiers to baord\n");
-                    destroy_bus_stops();
-                    destroy_shared_memory();
-                    exit(EXIT_FAILURE);
-                }
-
-                // allow n amount of passages to board                
-                for (int j = 0; j < amount_of_pasagers; j++) {
-                    if (sem_post(&bus_stops[Z-1]) < 0) {
-                        perror("faild to make space on the bus!\n");
-                        destroy_bus_stops();
-                        destroy_shared_memory();
-                        exit(EXIT_FAILURE);
-                    }
-                }
-
-                // the only way this will go throw, is when the last skier would free the bus_stop_sign
-                // this means, that the last skier has left
-                if (sem_wait(bus_stop_sign) < 0) {
-                    perror("Bus faild to wait for skiers to baord\n");
-                    destroy_bus_stops();
-                    destroy_shared_memory();
-                    exit(EXIT_FAILURE);
-                }
 
-                // free the stop sign
-                if (sem_post(bus_stop_sign) < 0) {
-                    perror("bus faild to leave the bus station\n");
-                    destroy_bus_stops();
-                    destroy_shared_memory();
-                    exit(EXIT_FAILURE);
-                }
-            }  
+    // a restored run without events has nothing after the checkpoint
+    if (truncate_pending && truncate_log(run_stats.events) < 0)
+        perror("failed to rewind the log file");
 
-            bus_leaving_final();
+    // the index is only saved for a complete log
+    if (out_file != NULL && fclose(out_file) == 0 && log_index != NULL &&
+        skibus_index_save(log_index, index_file_name, out_file_offset) < 0)
+        perror("failed to write the index");
+    skibus_index_destroy(log_index);
 
-            // if all the skiers have boarded, exit
-            if (shared_memory->skiers_boarded == L) {
-                bus_finished();
-                exit(EXIT_SUCCESS);
-            }
-        }
+    if (show_statistics) {
+        print_statistics();
+        print_memory_statistics();
     }
-}
 
-/**
- * @brief Main function.
- * @param argc The amount of arguments.
- * @param argv The arguments.
- * @return The exit status.
-*/
-int main(int argc, char *argv[]) {
-
-    // chekc for amoutn of arguments
-    if (argc != 6) {
-        printf("Invalid number of arguments!\n");
-        printf("Usage: ./ski-bus L Z K TL TB\n");
-        return 1;
+    if (report_file_name != NULL) {
+        print_report();
+        if (write_report_csv(report_file_name) < 0)
+            perror("failed to write the report");
     }
-    
-    // check for the validity of the arguments
-    char *endptr;
-    L = strtol(argv[1], &endptr, 10);
-    if (*endptr != '\0' || L < 0 || L >= 20000) {
-        printf("Invalid value for L!\n");
-        return 1;
-    }
-    
-    Z = strtol(argv[2], &endptr, 10);
-    if (*endptr != '\0' || Z <= 0 || Z > 10) {
-        printf("Invalid value for Z!\n");
-        return 1;
-    }
-    
-    K = strtol(argv[3], &endptr, 10);
-    if (*endptr != '\0' || K < 10 || K > 100) {
-        printf("Invalid value for K!\n");
-        return 1;
-    }
-    
-    TL = strtol(argv[4], &endptr, 10);
-    if (*endptr != '\0' || TL > 10000) {
-        printf("Invalid value for TL!\n");
-        return 1;
-    }
-    
-    TB = strtol(argv[5], &endptr, 10);
-    if (*endptr != '\0' || TB > 1000) {
-        printf("Invalid value for TB!\n");
-        return 1;
-    }
-
-    init_bus_stops();
-    init_shared_memory();
-    craete_ski_bus_process();
 
-    // wait for all the processes to finish
-    for (int i = 0; i < L + 2; i++) {
-        wait(NULL);
+    int status = 0;
+    if (memory_budget_kb > 0 && run_stats.memory_per_skier_kb > memory_budget_kb) {
+        fprintf(stderr, "memory budget exceeded: %.1f KiB per skier, the budget is %ld KiB\n",
+            run_stats.memory_per_skier_kb, memory_budget_kb);
+        status = 1;
     }
 
-    // clear the buffer
-    if (shared_memory->num_messages > 0) 
-        write_logs_to_file();
-        
-    destroy_bus_stops();
-    destroy_shared_memory();
-    
-    return 0;
-}
\ No newline at end of file
+    skibus_destroy(context);
+    return status;
+}
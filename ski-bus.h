@@ -4,233 +4,183 @@ _______________________________
  * Name: Martin Mendl
  * Email: x247581@fit.vutbr.cz
  * Date: 26.4. 2024
- * file: header file for ski-bus.c
+ * file: header file for ski-bus.c, the command line front end of libskibus
 _______________________________
 */
 
 
-#ifndef PROJECT_H
-#define PROJECT_H
+#ifndef SKI_BUS_H
+#define SKI_BUS_H
+
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/wait.h>
-#include <semaphore.h>
-#include <sys/mman.h>
 #include <stdbool.h>
-#include <time.h>
+#include <getopt.h>
+#include <signal.h>
 
-/**
- * Number of skiers.
- */
-long L;
+#include "skibus.h"
 
 /**
- * Number of bus stops.
+ * Names of the arrival profiles on the command line.
  */
-long Z;
+const char *arrival_profile_names[] = { "none", "uniform", "poisson", "peak", "bursty" };
 
 /**
- * Maximum bus capacity.
+ * Names of the wait strategies on the command line.
  */
-long K;
+const char *wait_strategy_names[] = { "block", "adaptive" };
 
 /**
- * Max time in microseconds for skier to sleep.
+ * Names of the skier modes on the command line.
  */
-long TL;
-
-/**
- * Max time in microseconds for bus to sleep.
- */
-long TB;
-
-/**
- * Maximum amount of log messages to strore.
-*/
-#define MAX_LOG_MESSAGES 10
+const char *skier_mode_names[] = { "process", "clone" };
 
 /**
- * Max amount of characters in the log message
-*/
-#define MAX_MESSAGE_LENGTH 30
-
-/**
- * @brief Struct for shared data among processes.
+ * Names of the pages backing the shared memory on the command line.
  */
-typedef struct {
-    int ID; /**< ID of the shared data. */
-    int skiers_boarded; /**< Amount of skiers that have boarded the bus combined. If -1, error occurred. */
-    int occupancy; /**< The amount of people on the bus. */
-    int amount_of_skiers_to_board; /**< Amount of people waiting for the next ride. */
-    FILE *out_file; /**< File pointer to store the logs from the program. */
-    char log_messages[MAX_LOG_MESSAGES][MAX_MESSAGE_LENGTH]; /**< Array to store log messages. */
-    int num_messages; /**< Number of log messages currently stored. */
-} shared_data;
+const char *page_backing_names[] = { "normal", "thp", "hugetlb" };
 
 /**
- * Output file name.
+ * Print run statistics to stderr once the simulation finishes.
  */
-char out_file_name[] = "ski-bus.out";
+bool show_statistics = false;
 
 /**
- * Pointer to shared memory segment.
+ * Start every log line with the model time of its event.
  */
-shared_data* shared_memory;
+bool show_timestamps = false;
 
 /**
- * Array representing the skier amount that are waiting at each stop.
+ * Memory in KiB a single skier may cost, 0 for no budget.
  */
-int* skiers_waiting;
+long memory_budget_kb = 0;
 
 /**
- * Array of semaphores for bus stops, accounting for the last stop as well.
+ * File for the per stop report as CSV, NULL for no report.
  */
-sem_t* bus_stops;
+const char *report_file_name = NULL;
 
 /**
- * Semaphore where skiers will wait until the bus finishes the route.
+ * Name of the output file.
  */
-sem_t* bus_stop_sign;
-
-/**
- * Semaphore for accessing shared data.
- */
-sem_t* datafor;
-
-/**
- * Semaphore for printing out data.
- */
-sem_t* printafor;
-
-/**
- * the string, that will be written to the log file
-*/
-char log_message[MAX_MESSAGE_LENGTH];
-
-/**
- * @brief Adds a log message to the buffer
- * 
- * @param message The message to be added.
-*/
-void add_log_message(const char *message);
-
-/**
- * @brief dumps the buffer to the file
- * 
-*/
-void write_logs_to_file();
+const char *out_file_name = "ski-bus.out";
 
 /**
- * @brief Initializes the bus stops.
+ * The output file, every event is written to it as a line.
  */
-void init_bus_stops();
+FILE *out_file = NULL;
 
 /**
- * @brief Destroys the bus stops.
+ * Buffer of the output file, the lines are written in large blocks.
  */
-void destroy_bus_stops();
+char out_file_buffer[1 << 16];
 
 /**
- * @brief Initializes the shared memory.
+ * File for the index of the output file, NULL for no index.
  */
-void init_shared_memory();
+const char *index_file_name = NULL;
 
 /**
- * @brief Destroys the shared memory.
+ * The index of the output file, built while it is written.
  */
-void destroy_shared_memory();
+skibus_index *log_index = NULL;
 
 /**
- * @brief Waits for my turn to access shared data.
+ * Bytes written to the output file so far, the offset of the next line.
  */
-void wait_for_my_turn();
+long long out_file_offset = 0;
 
 /**
- * @brief Releases my turn to access shared data.
+ * The log of a restored run still has to be cut back to the checkpoint.
  */
-void done_with_my_turn();
+bool truncate_pending = false;
 
 /**
- * @brief Sleeps for a random time.
- * 
- * @param max_value The maximum value for the random sleep time.
+ * Statistics of the finished run.
  */
-void random_sleep(int max_value);
+skibus_stats run_stats;
 
 /**
- * @brief Function called when the bus starts its journey.
+ * The context of the run, for the signal handler.
  */
-void bus_started();
+skibus_context *context = NULL;
 
 /**
- * @brief Function called when the bus arrives at a bus stop.
- * 
- * @param idZ The ID of the bus stop.
+ * @brief Cuts the log back to its first lines and carries on writing after them.
+ *
+ * @param lines The amount of lines to keep.
+ * @return 0 on success, -1 on failure.
  */
-void bus_arrived(int idZ);
+int truncate_log(int lines);
 
 /**
- * @brief Function called when the bus leaves a bus stop.
- * 
- * @param idZ The ID of the bus stop.
+ * @brief Prints an event to stdout and to the output file.
+ *
+ * @param event The event.
+ * @param user Unused.
  */
-void bus_leaving(int idZ);
+void print_event(const skibus_event *event, void *user);
 
 /**
- * @brief Function called when the bus arrives at the final stop.
+ * @brief Adds an event to the index of the output file, a failure drops the index.
+ *
+ * @param event The event.
+ * @param offset The offset of the line of the event in the output file.
  */
-void bus_arrived_to_final();
+void index_event(const skibus_event *event, long long offset);
 
 /**
- * @brief Function called when the bus leaves the final stop.
+ * @brief Makes the output file end exactly at the checkpoint.
+ *
+ * @param user Unused.
  */
-void bus_leaving_final();
+void flush_log(void *user);
 
 /**
- * @brief Function called when the bus finishes its journey.
+ * @brief Keeps the statistics of the finished run.
+ *
+ * @param stats The statistics.
+ * @param user Unused.
  */
-void bus_finished();
+void keep_statistics(const skibus_stats *stats, void *user);
 
 /**
- * @brief Function called when a skier starts skiing.
- * 
- * @param idL The ID of the skier.
+ * @brief Prints the run statistics to stderr.
  */
-void skier_started(int idL);
+void print_statistics();
 
 /**
- * @brief Function called when a skier arrives at a bus stop.
- * 
- * @param idL The ID of the skier.
- * @param idZ The ID of the bus stop.
+ * @brief Prints the memory of the run to stderr.
  */
-void skier_arrived(int idL, int idZ);
+void print_memory_statistics();
 
 /**
- * @brief Function called when a skier is boarding the bus.
- * 
- * @param idL The ID of the skier.
+ * @brief Prints the trips and the stops of every line to stderr.
  */
-void skier_boarding(int idL);
+void print_report();
 
 /**
- * @brief Function called when a skier reaches the sky.
- * 
- * @param idL The ID of the skier.
+ * @brief Writes a row per stop of every line as CSV.
+ *
+ * @param file_name The CSV file.
+ * @return 0 on success, -1 if the file could not be written.
  */
-void skier_sky(int idL);
+int write_report_csv(const char *file_name);
 
 /**
- * @brief Creates processes for skiers.
+ * @brief Asks the running simulation for a checkpoint.
+ *
+ * @param sig The signal number.
  */
-void create_skiers_processes();
+void request_checkpoint(int sig);
 
 /**
- * @brief Creates a process for the ski bus.
+ * @brief Prints the usage of the program.
  */
-void create_ski_bus_process();
+void print_usage();
 
 #endif
@@ -0,0 +1,346 @@
+/** AUTHOR
+_______________________________
+
+ * Name: Martin Mendl
+ * Email: x247581@fit.vutbr.cz
+ * Date: 26.4. 2024
+ * file: part of libskibus, the index of a log by skier and by stop
+_______________________________
+*/
+
+
+#define _GNU_SOURCE
+
+#include "skibus-internal.h"
+
+/**
+ * @brief Creates an empty index to build while writing a log.
+ * @return The index, NULL if out of memory.
+*/
+skibus_index* skibus_index_create() {
+    return calloc(1, sizeof(skibus_index));
+}
+
+/**
+ * @brief Adds an event to an index being built, the entries grow by doubling.
+ * @param index The index.
+ * @param event The event, the events have to come in order from ID 1.
+ * @param offset The offset of the line of the event in the log.
+ * @return 0 on success, -1 if out of memory or out of order.
+*/
+int skibus_index_add(skibus_index *index, const skibus_event *event, long long offset) {
+    index_header *header = &index->header;
+
+    if (index->map != NULL || event->id != header->events + 1 || event->skier < 0 ||
+        event->stop < 0 || event->stop > MAX_STOPS)
+        return -1;
+
+    if (header->events == index->capacity) {
+        int capacity = index->capacity > 0 ? index->capacity * 2 : 4096;
+        skibus_index_entry *entries = realloc(index->entries, sizeof(skibus_index_entry) * capacity);
+        if (entries == NULL)
+            return -1;
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+
+    index->entries[header->events++] = (skibus_index_entry){
+        .offset = offset,
+        .model_time_us = event->model_time_us,
+        .skier = event->skier,
+        .type = event->type,
+        .bus = event->bus,
+        .stop = event->stop,
+    };
+
+    // the lists are only counted, they are built when saving
+    if (event->skier >= header->skiers)
+        header->skiers = event->skier + 1;
+    header->skier_ids += event->skier > 0;
+    header->stop_ids += event->stop > 0;
+    return 0;
+}
+
+/**
+ * @brief Builds the lists of one key of the events. The events are walked in order, so the IDs
+ * in every list are in order too.
+ * @param index The index being built.
+ * @param stop Key the events by stop, else by skier.
+ * @param keys Amount of keys.
+ * @param start Filled with keys + 1 starts.
+ * @param ids Filled with the IDs.
+*/
+static void build_lists(const skibus_index *index, bool stop, int keys, int *start, int *ids) {
+    memset(start, 0, sizeof(int) * (keys + 1));
+
+    for (int i = 0; i < index->header.events; i++) {
+        int key = stop ? index->entries[i].stop : index->entries[i].skier;
+        if (key > 0)
+            start[key + 1]++;
+    }
+    for (int key = 0; key < keys; key++)
+        start[key + 1] += start[key];
+
+    // start[key] is moved along while filling, then moved back
+    for (int i = 0; i < index->header.events; i++) {
+        int key = stop ? index->entries[i].stop : index->entries[i].skier;
+        if (key > 0)
+            ids[start[key]++] = i + 1;
+    }
+    for (int key = keys; key > 0; key--)
+        start[key] = start[key - 1];
+    start[0] = 0;
+}
+
+/**
+ * @brief Saves an index being built, next to the old one until it is complete.
+ * @param index The index.
+ * @param file_name The index file.
+ * @param log_size The size of the log once it is complete.
+ * @return 0 on success, -1 if the file could not be written.
+*/
+int skibus_index_save(const skibus_index *index, const char *file_name, long long log_size) {
+    index_header header = index->header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.log_size = log_size;
+    header.stops = MAX_STOPS + 1;
+    if (header.skiers == 0)
+        header.skiers = 1;
+
+    int *skier_start = malloc(sizeof(int) * (header.skiers + 1));
+    int *stop_start = malloc(sizeof(int) * (header.stops + 1));
+    int *skier_ids = malloc(sizeof(int) * (header.skier_ids + 1));
+    int *stop_ids = malloc(sizeof(int) * (header.stop_ids + 1));
+    char temp_name[256];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", file_name);
+    FILE *file = NULL;
+
+    bool ok = skier_start != NULL && stop_start != NULL && skier_ids != NULL && stop_ids != NULL &&
+        (file = fopen(temp_name, "wb")) != NULL;
+
+    if (ok) {
+        build_lists(index, false, header.skiers, skier_start, skier_ids);
+        build_lists(index, true, header.stops, stop_start, stop_ids);
+
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(index->entries, sizeof(skibus_index_entry), header.events, file) == (size_t)header.events &&
+            fwrite(skier_start, sizeof(int), header.skiers + 1, file) == (size_t)header.skiers + 1 &&
+            fwrite(stop_start, sizeof(int), header.stops + 1, file) == (size_t)header.stops + 1 &&
+            fwrite(skier_ids, sizeof(int), header.skier_ids, file) == (size_t)header.skier_ids &&
+            fwrite(stop_ids, sizeof(int), header.stop_ids, file) == (size_t)header.stop_ids;
+    }
+
+    free(skier_start);
+    free(stop_start);
+    free(skier_ids);
+    free(stop_ids);
+
+    if (file == NULL)
+        return -1;
+    if (fclose(file) != 0 || !ok || rename(temp_name, file_name) < 0) {
+        unlink(temp_name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks the starts of the lists of an opened index, they have to begin at 0, never
+ * go back and end at the amount of IDs.
+ * @param start The keys + 1 starts.
+ * @param keys Amount of keys.
+ * @param ids Amount of IDs in the lists.
+ * @return true if the starts are valid.
+*/
+static bool check_starts(const int *start, int keys, int ids) {
+    if (start[0] != 0 || start[keys] != ids)
+        return false;
+    for (int key = 0; key < keys; key++) {
+        if (start[key + 1] < start[key])
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks the IDs of the lists of an opened index, every one has to be an event of it.
+ * @param ids The IDs.
+ * @param count Amount of IDs.
+ * @param events Amount of events.
+ * @return true if the IDs are valid.
+*/
+static bool check_ids(const int *ids, int count, int events) {
+    for (int i = 0; i < count; i++) {
+        if (ids[i] < 1 || ids[i] > events)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks the offsets of the events of an opened index, they may not go back and have
+ * to lie in the log.
+ * @param entries The events.
+ * @param events Amount of events.
+ * @param log_size The size of the log.
+ * @return true if the offsets are valid.
+*/
+static bool check_offsets(const skibus_index_entry *entries, int events, long long log_size) {
+    long long previous = 0;
+    for (int i = 0; i < events; i++) {
+        if (entries[i].offset < previous || entries[i].offset > log_size)
+            return false;
+        previous = entries[i].offset;
+    }
+    return true;
+}
+
+/**
+ * @brief Maps a saved index and checks, that its lists and offsets fit into it and the log.
+ * @param file_name The index file.
+ * @return The index, NULL if it is invalid.
+*/
+skibus_index* skibus_index_open(const char *file_name) {
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    index_header *header = size >= sizeof(index_header) ?
+        mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0) : MAP_FAILED;
+    fclose(file);
+
+    if (header == MAP_FAILED)
+        return NULL;
+
+    size_t expected = sizeof(index_header) + sizeof(skibus_index_entry) * (size_t)header->events +
+        sizeof(int) * ((size_t)header->skiers + 1 + header->stops + 1 + header->skier_ids + header->stop_ids);
+    skibus_index *index = calloc(1, sizeof(skibus_index));
+
+    if (index == NULL || memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->events < 0 || header->skiers < 1 || header->stops < 1 ||
+        header->skier_ids < 0 || header->stop_ids < 0 || size != expected) {
+        free(index);
+        munmap(header, size);
+        return NULL;
+    }
+
+    index->header = *header;
+    index->map = header;
+    index->map_size = size;
+    index->entries = (skibus_index_entry *)(header + 1);
+    index->skier_start = (const int *)(index->entries + header->events);
+    index->stop_start = index->skier_start + header->skiers + 1;
+    index->skier_ids = index->stop_start + header->stops + 1;
+    index->stop_ids = index->skier_ids + header->skier_ids;
+
+    // the lists and the offsets are read without checks later on
+    if (!check_starts(index->skier_start, header->skiers, header->skier_ids) ||
+        !check_starts(index->stop_start, header->stops, header->stop_ids) ||
+        !check_ids(index->skier_ids, header->skier_ids, header->events) ||
+        !check_ids(index->stop_ids, header->stop_ids, header->events) ||
+        !check_offsets(index->entries, header->events, header->log_size)) {
+        skibus_index_destroy(index);
+        return NULL;
+    }
+    return index;
+}
+
+/**
+ * @brief Destroys an index, built or opened.
+ * @param index The index.
+*/
+void skibus_index_destroy(skibus_index *index) {
+    if (index == NULL)
+        return;
+    if (index->map != NULL)
+        munmap(index->map, index->map_size);
+    else
+        free(index->entries);
+    free(index);
+}
+
+/**
+ * @brief Returns the amount of events in an index.
+ * @param index The index.
+*/
+int skibus_index_events(const skibus_index *index) {
+    return index->header.events;
+}
+
+/**
+ * @brief Returns the size of the log an opened index was saved for.
+ * @param index The index.
+*/
+long long skibus_index_log_size(const skibus_index *index) {
+    return index->header.log_size;
+}
+
+/**
+ * @brief Returns an event of an index.
+ * @param index The index.
+ * @param id The ID of the event.
+ * @return The event, NULL if there is no such event.
+*/
+const skibus_index_entry* skibus_index_event(const skibus_index *index, int id) {
+    if (id < 1 || id > index->header.events)
+        return NULL;
+    return &index->entries[id - 1];
+}
+
+/**
+ * @brief Returns the events of a skier in an opened index.
+ * @param index The index.
+ * @param skier The ID of the skier.
+ * @param ids Filled with the IDs of the events, in order.
+ * @return The amount of events.
+*/
+int skibus_index_skier(const skibus_index *index, int skier, const int **ids) {
+    if (index->map == NULL || skier < 1 || skier >= index->header.skiers)
+        return 0;
+
+    *ids = index->skier_ids + index->skier_start[skier];
+    return index->skier_start[skier + 1] - index->skier_start[skier];
+}
+
+/**
+ * @brief Returns the events at a stop in a range of IDs in an opened index, the ends of
+ * the range are found by binary search in the list of the stop.
+ * @param index The index.
+ * @param stop The ID of the stop.
+ * @param first The first ID of the range.
+ * @param last The last ID of the range.
+ * @param ids Filled with the IDs of the events, in order.
+ * @return The amount of events.
+*/
+int skibus_index_stop(const skibus_index *index, int stop, int first, int last, const int **ids) {
+    if (index->map == NULL || stop < 1 || stop >= index->header.stops || first > last)
+        return 0;
+
+    const int *list = index->stop_ids + index->stop_start[stop];
+    int count = index->stop_start[stop + 1] - index->stop_start[stop];
+
+    // the first entry not below first, then the first entry above last
+    int low = 0, high = count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (list[middle] < first)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    int begin = low;
+    high = count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (list[middle] <= last)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    *ids = list + begin;
+    return low - begin;
+}
@@ -0,0 +1,1149 @@
+/** AUTHOR
+_______________________________
+
+ * Name: Martin Mendl
+ * Email: x247581@fit.vutbr.cz
+ * Date: 26.4. 2024
+ * file: internal header file of libskibus, for skibus.c
+_______________________________
+*/
+
+
+#ifndef SKIBUS_INTERNAL_H
+#define SKIBUS_INTERNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sched.h>
+#include <math.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <stdint.h>
+
+#include "skibus.h"
+
+/**
+ * The semaphores, the sleeps and the exits of the workers make their system calls straight,
+ * which is only written for these architectures.
+ */
+#if !defined(__x86_64__) && !defined(__aarch64__)
+#error "libskibus makes raw system calls, which are only written for x86-64 and AArch64"
+#endif
+
+/**
+ * @brief A process shared counting semaphore on a futex. It never touches errno or any other
+ * thread local state of the C library, the cloned skiers share all of it with the caller.
+ */
+typedef struct {
+    int value; /**< Tokens left. */
+    int sleepers; /**< Waiters inside the futex wait, a post without them needs no system call. */
+} semaphore;
+
+/**
+ * Bounds of the spin budget of the adaptive wait, in spin iterations.
+ */
+#define MIN_SPIN 16
+#define MAX_SPIN 16384
+
+/**
+ * Longest pause between two checks of the semaphore while spinning.
+ */
+#define MAX_BACKOFF 64
+
+/**
+ * Waits shorter than this on average are worth spinning for, in nanoseconds.
+ */
+#define SPIN_BUDGET_NS 20000
+
+/**
+ * @brief Adaptive spinning of one wait point of one skier or bus.
+ */
+typedef struct {
+    int limit; /**< Current spin budget. */
+    long long average_ns; /**< Moving average of the recent wait durations. */
+    long long hits; /**< Waits over while spinning. */
+    long long blocks; /**< Waits that had to block. */
+} spin_state;
+
+/**
+ * Stack of a cloned skier, below it lies a guard page.
+ */
+#define SKIER_STACK_SIZE (32 * 1024)
+
+/**
+ * @brief Memory of the running simulation, in KiB.
+ */
+typedef struct {
+    long long rss_kb; /**< Resident set summed over the processes, shared pages count in every process. */
+    long long pss_kb; /**< Proportional set, shared pages are split among the processes mapping them. */
+    long long kernel_kb; /**< Kernel stacks and page tables of the whole system. */
+} memory_usage;
+
+/**
+ * Shortest real time in microseconds between two memory samples, slow samples are taken less often.
+ */
+#define MEMORY_SAMPLE_US 10000
+
+/**
+ * Shortest real time in microseconds between two checks for exited workers.
+ */
+#define REAP_US 10000
+
+/**
+ * Longest real time in microseconds the main process waits for an event, before it looks after the run.
+ */
+#define EVENT_WAIT_US 1000
+
+/**
+ * Real sleeps shorter than this many microseconds only yield the CPU.
+ */
+#define SLEEP_FLOOR_US 10
+
+/**
+ * Maximum amount of events on their way to the main process.
+ */
+#define EVENT_RING 4096
+
+/**
+ * Maximum length of the reason of a failure.
+ */
+#define MAX_ERROR_LENGTH 128
+
+/**
+ * Size of a cache line, the unit the processes fight over when they write shared memory.
+ */
+#define CACHE_LINE 64
+
+/**
+ * Puts a type or a field at the start of a cache line of its own.
+ */
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
+
+/**
+ * Size of a huge page, the shared memory is rounded up to it when it asks for huge pages.
+ */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * @brief The single mapping all shared state of a run is carved from.
+ */
+typedef struct {
+    char *base; /**< Start of the mapping, NULL while the layout is only being measured. */
+    size_t size; /**< Size of the mapping. */
+    size_t used; /**< Bytes handed out so far. */
+    skibus_page_backing backing; /**< Pages the mapping got. */
+} shared_arena;
+
+/**
+ * Short names of the limits of the public interface.
+ */
+#define MAX_TL SKIBUS_MAX_TL
+#define MAX_TB SKIBUS_MAX_TB
+#define MAX_LINES SKIBUS_MAX_LINES
+#define MAX_LINE_STOPS SKIBUS_MAX_LINE_STOPS
+#define MAX_STOPS SKIBUS_MAX_STOPS
+#define MAX_CAPACITY SKIBUS_MAX_CAPACITY
+
+/**
+ * @brief One bus line of the route network.
+ */
+typedef skibus_line route_line;
+
+/**
+ * @brief One ride of a skier's route, on a single line.
+ */
+typedef struct {
+    int line; /**< Index of the line to ride. */
+    int board; /**< Position on the line where the skier gets on. */
+    int alight; /**< Position on the line where the skier gets off. */
+} route_leg;
+
+/**
+ * @brief Travel time of the bus to one position of its line, resolved from the scenario
+ * before the run so the bus only draws from it.
+ */
+typedef struct {
+    skibus_travel_kind kind; /**< Distribution of the travel time. */
+    long min_us; /**< Shortest travel time in model microseconds. */
+    long max_us; /**< Longest travel time in model microseconds. */
+    long mean_us; /**< Mean of the exponential part in model microseconds. */
+} hop_time;
+
+/**
+ * @brief Synchronization of one stop of one line, on cache lines of its own, since the skiers
+ * of different stops touch it at the same time.
+ */
+typedef struct CACHE_ALIGNED {
+    semaphore alight; /**< Riders waiting to get off the bus at this stop. */
+    int head; /**< Skier with the oldest ticket waiting for this line at this stop, -1 if none. */
+    int tail; /**< Skier with the newest ticket, -1 if none. */
+    int waiting; /**< Amount of skiers waiting for this line at this stop. */
+    int alighting; /**< Amount of riders that get off at this stop. */
+} line_stop;
+
+/**
+ * @brief Shared state of one bus line, guarded by its own lock. The table the bus reads per hop,
+ * the stop sign it spins on and the lock with the counters behind it are each on cache lines of
+ * their own.
+ */
+typedef struct CACHE_ALIGNED {
+    int capacity; /**< Capacity of the bus, it never changes during the run. */
+    hop_time hops[MAX_LINE_STOPS]; /**< Travel time to every position, from the one before it, the first from the terminal. */
+    semaphore bus_stop_sign CACHE_ALIGNED; /**< Semaphore where the bus waits until the last skier has boarded or left. */
+    semaphore lock CACHE_ALIGNED; /**< Semaphore for accessing the counters of this line and its stops. */
+    int occupancy; /**< The amount of people on the bus. */
+    int pending; /**< Skiers still to board or leave the bus at the current stop. */
+    int position; /**< Position on the line of the stop the bus is at or travelling to. */
+    bool at_stop; /**< The bus has arrived at its position and not left yet. */
+    bool started; /**< The bus has announced its start. */
+    bool finished; /**< The bus has announced its finish. */
+    unsigned int rng; /**< Random stream of the bus. */
+    spin_state sign_spin; /**< Spinning of the bus at the stop sign. */
+    long long travel_us; /**< Model time the bus has spent travelling between stops. */
+    long long seat_us; /**< Sum of the model time every rider has spent travelling on the bus. */
+    long long handoff_ns; /**< Real time the bus has spent letting skiers on and off. */
+    long long handoffs; /**< Amount of times the bus has let skiers on or off. */
+    long long arrived_us; /**< Model time the bus has arrived at its position. */
+    long long trip_start_us; /**< Model time the current trip has started. */
+    int trip_peak; /**< Highest load of the current trip. */
+    bool trip_full; /**< The current trip has left a stop with every seat taken. */
+    bool trip_left_behind; /**< The current trip has left a skier behind. */
+    skibus_line_stats report CACHE_ALIGNED; /**< Trips and stops of the line so far. */
+    line_stop stops[MAX_LINE_STOPS]; /**< Per stop synchronization, indexed by position on the line. */
+} bus_line;
+
+/**
+ * @brief Phases of a skier, the skier is blocked in at most one of them.
+ */
+typedef enum {
+    SKIER_STARTING, /**< Not started yet. */
+    SKIER_WALKING, /**< On the way to the first stop of the lap. */
+    SKIER_WAITING, /**< Counted as waiting at the board stop of the current leg. */
+    SKIER_RIDING, /**< On the bus of the current leg. */
+    SKIER_TRANSFERRING, /**< Got off, not counted at the next stop yet. */
+    SKIER_DONE, /**< Done skiing for the day. */
+} skier_phase;
+
+/**
+ * @brief State of one skier, kept as data so it can be checkpointed.
+ */
+typedef struct {
+    skier_phase phase; /**< What the skier is doing. */
+    int lap; /**< Amount of laps finished. */
+    int origin; /**< ID of the stop the current lap starts at. */
+    int leg; /**< Index of the current ride. */
+    int leg_count; /**< Amount of rides in the current lap. */
+    route_leg legs[MAX_LINES]; /**< Rides of the current lap. */
+    unsigned int rng; /**< Random stream of the skier. */
+    spin_state board_spin; /**< Spinning of the skier for its turn to board. */
+    spin_state alight_spin; /**< Spinning of the skier for its stop to get off at. */
+    long long ticket; /**< Ticket taken at the current stop, earlier tickets board first. */
+    long long queued_us; /**< Model time the skier took the ticket. */
+    int next; /**< Next skier in the queue of the stop, -1 if none. */
+} skier_state;
+
+/**
+ * Buckets of the boarding wait histogram.
+ */
+#define WAIT_BUCKETS 48
+
+/**
+ * @brief Struct for shared data among processes. The fields are grouped by who writes them,
+ * every group on a cache line of its own, so taking a ticket does not slow down reading the clock.
+ */
+typedef struct CACHE_ALIGNED {
+    struct timespec start_time; /**< Real time at which the simulation started, only read during the run. */
+    int ID CACHE_ALIGNED; /**< ID of the last event, guarded by printafor. */
+    long long next_ticket CACHE_ALIGNED; /**< Next ticket handed out at a stop. */
+    long long wait_histogram[WAIT_BUCKETS] CACHE_ALIGNED; /**< Boarding waits, bucket i counts waits under 2^i model microseconds. */
+    long long max_wait_us; /**< Longest boarding wait in model microseconds. */
+    int skiers_boarded CACHE_ALIGNED; /**< Amount of skiers that have boarded the bus combined, guarded by datafor with the rest of the group. */
+    int skiers_finished; /**< Amount of rides, that have reached a lift. */
+    int skiers_done; /**< Amount of skiers, that are done skiing for the day. */
+    long long warm_time_us; /**< Model time at which the first L rides have reached a lift. */
+    long long cool_time_us; /**< Model time at which the day started winding down. */
+    int rides_at_cool; /**< Amount of rides, that had reached a lift when the day started winding down. */
+    int next_arrival CACHE_ALIGNED; /**< Index of the next arrival the injector releases. */
+} shared_data;
+
+/**
+ * @brief Channel from the workers to the main process, it is not part of a checkpoint.
+ * The side of the main process and the side of the workers are on separate cache lines.
+ */
+typedef struct CACHE_ALIGNED {
+    semaphore ready CACHE_ALIGNED; /**< Events the main process has not taken yet. */
+    semaphore free CACHE_ALIGNED; /**< Free entries of the ring. */
+    int head CACHE_ALIGNED; /**< Next event the main process takes. */
+    int tail CACHE_ALIGNED; /**< Next entry a worker fills, guarded by printafor. */
+    int workers_running CACHE_ALIGNED; /**< Workers, that have not finished yet. */
+    int failed; /**< A worker has failed. */
+    int error_number; /**< Error number of the first failure, turned into text by the main process. */
+    char error[MAX_ERROR_LENGTH]; /**< Reason of the first failure. */
+    skibus_event events[EVENT_RING] CACHE_ALIGNED; /**< The ring of events. */
+} run_channel;
+
+/**
+ * @brief One entry of the arrival schedule.
+ */
+typedef struct {
+    long long time_us; /**< Model time of the arrival. */
+    int idL; /**< Index of the arriving skier. */
+} arrival;
+
+/**
+ * @brief Arrival of one skier.
+ */
+typedef struct {
+    semaphore sign; /**< Semaphore the skier waits on until the injector lets it arrive. */
+    int stop; /**< ID of the stop the skier arrives at. */
+    bool released; /**< The injector has let the skier arrive. */
+} skier_arrival;
+
+/**
+ * @brief Argument of a skier process or clone.
+ */
+typedef struct {
+    skibus_context *ctx; /**< The context of the run. */
+    int idL; /**< Index of the skier. */
+} skier_worker_arg;
+
+/**
+ * Identifies a checkpoint file and its layout version.
+ */
+#define CHECKPOINT_MAGIC "SKIBUS7"
+
+/**
+ * @brief Header of a checkpoint file, the configuration of the run. It is followed by
+ * shared_data, route_count bus_line, L skier_state and, with an arrival profile,
+ * L arrival and L skier_arrival. It fills whole cache lines, so the mapped regions after it
+ * stay aligned.
+ */
+typedef struct CACHE_ALIGNED {
+    char magic[8]; /**< CHECKPOINT_MAGIC. */
+    long L, Z, K, TL, TB; /**< Arguments of the run. */
+    double time_scale; /**< Factor of model time over real time. */
+    long laps; /**< Laps of every skier. */
+    long long duration; /**< Model duration of the day, 0 to count laps. */
+    skibus_arrival_profile arrival_profile; /**< Profile of the arrival schedule. */
+    int route_count; /**< Amount of bus lines. */
+    route_line routes[MAX_LINES]; /**< The route network. */
+    long long model_time_us; /**< Model time at the checkpoint. */
+} checkpoint_header;
+
+/**
+ * Identifies an index file and its layout version.
+ */
+#define INDEX_MAGIC "SKIDX01"
+
+/**
+ * @brief Header of an index file. It is followed by the events, then skiers + 1 and stops + 1
+ * starts of the lists, then the lists of event IDs of every skier and of every stop. List s is
+ * from start[s] to start[s + 1] and the IDs in it are in order.
+ */
+typedef struct {
+    char magic[8]; /**< INDEX_MAGIC. */
+    long long log_size; /**< Size of the log the index was saved for. */
+    int events; /**< Amount of events. */
+    int skiers; /**< Highest skier ID plus one. */
+    int stops; /**< Highest stop ID plus one. */
+    int skier_ids; /**< Entries of all the skier lists. */
+    int stop_ids; /**< Entries of all the stop lists. */
+    int reserved; /**< Zero. */
+} index_header;
+
+/**
+ * @brief Index of a log, built in memory or mapped from a file.
+ */
+struct skibus_index {
+    index_header header; /**< Counts of the index. */
+    skibus_index_entry *entries; /**< The events, indexed by ID - 1. */
+    int capacity; /**< Entries allocated while building. */
+    const int *skier_start, *skier_ids; /**< Lists of the skiers of an opened index. */
+    const int *stop_start, *stop_ids; /**< Lists of the stops of an opened index. */
+    void *map; /**< The mapped file, NULL while building. */
+    size_t map_size; /**< Size of the mapping. */
+};
+
+/**
+ * @brief Everything a run needs, it used to be the globals of the ski-bus program.
+ */
+struct skibus_context {
+    long L; /**< Number of skiers. */
+    long Z; /**< Number of bus stops. */
+    long K; /**< Maximum bus capacity. */
+    long TL; /**< Max time in model microseconds for skier to sleep. */
+    long TB; /**< Max time in model microseconds for bus to sleep. */
+    double time_scale; /**< Factor by which model time runs faster than real time. */
+    long laps; /**< Amount of laps every skier does, a lap ends by going to ski. */
+    long long duration; /**< Model time after which skiers stop starting new laps, 0 to count laps instead. */
+    skibus_arrival_profile arrival_profile; /**< Profile of the precomputed arrival schedule. */
+    skibus_wait_strategy wait_strategy; /**< Wait strategy of the handshake points. */
+    skibus_skier_mode skier_mode; /**< How the skiers are run. */
+
+    route_line routes[MAX_LINES]; /**< Bus lines of the route network, each served by its own bus process. */
+    int route_count; /**< Amount of bus lines in the route network. */
+    int route_origins[MAX_STOPS], route_origin_count; /**< Stops where skiers can wait for a bus, and their amount. */
+    int route_lifts[MAX_STOPS], route_lift_count; /**< Distinct lifts at the terminals of the lines, and their amount. */
+    int line_capacity[MAX_LINES]; /**< Capacity of the bus of every line. */
+    hop_time line_hops[MAX_LINES][MAX_LINE_STOPS]; /**< Travel times of every line, indexed as in bus_line. */
+
+    skibus_page_backing huge_pages; /**< Pages the arena asks for. */
+    shared_arena arena; /**< The mapping all the shared state below lives in. */
+    shared_data *shared_memory; /**< Pointer to shared memory segment. */
+    bus_line *bus_lines; /**< Array of the shared bus line states, one per route line. */
+    run_channel *channel; /**< Events and failures on their way to the main process. */
+    arrival *arrival_schedule; /**< Arrival schedule sorted by time, L entries. */
+    skier_arrival *skier_arrivals; /**< Arrivals indexed by skier, L entries. */
+    skier_state *skiers; /**< States of the skiers, L entries. */
+    semaphore *skier_wakes; /**< Semaphores the skiers wait on for their turn to board, L entries. */
+    semaphore *datafor; /**< Semaphore for accessing shared data. */
+    semaphore *printafor; /**< Semaphore for logging events. */
+    unsigned int main_rng; /**< Random stream of the main process, the buses and skiers have their own in their state. */
+
+    char *skier_stacks; /**< Stacks of the cloned skiers, one guard page and SKIER_STACK_SIZE per skier. */
+    size_t skier_stacks_size; /**< Size of the mapping of skier_stacks. */
+    skier_worker_arg *skier_args; /**< Arguments of the skier workers, L entries. */
+    pid_t *worker_pids; /**< Workers, that have not been waited for yet. */
+    int worker_count; /**< Amount of entries in worker_pids. */
+    pid_t *memory_pids; /**< Workers with an address space of their own, they are sampled on top of the main process. */
+    int memory_count; /**< Amount of entries in memory_pids. */
+    int skier_workers; /**< Amount of skiers the run has created a process or clone for. */
+
+    bool sample_memory; /**< Sample the memory of the workers. */
+    memory_usage memory_base; /**< Memory before the skiers were created. */
+    memory_usage memory_peak; /**< Peaks during the run, each field peaks on its own. */
+
+    const char *checkpoint_file_name; /**< Checkpoint file, NULL to disable. */
+    double checkpoint_interval; /**< Model seconds between checkpoints, 0 to only checkpoint on request. */
+    volatile sig_atomic_t checkpoint_requested; /**< Set by skibus_request_checkpoint. */
+
+    skibus_callbacks callbacks; /**< Receivers of the output. */
+    char error[MAX_ERROR_LENGTH]; /**< Reason the last run failed. */
+};
+
+/**
+ * @brief Hint to the CPU, that we are spinning.
+ */
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * @brief Records the reason of a failure of the main process.
+ *
+ * @param ctx The context.
+ * @param message The reason.
+ * @return -1, for returning it.
+ */
+int set_error(skibus_context *ctx, const char *message);
+
+/**
+ * @brief Ends a worker, that has failed.
+ *
+ * @param ctx The context.
+ * @param message The reason.
+ * @param error The negative error number of the failed call.
+ */
+void worker_fail(skibus_context *ctx, const char *message, int error);
+
+/**
+ * @brief Ends a worker, that is done.
+ *
+ * @param ctx The context.
+ */
+void worker_exit(skibus_context *ctx);
+
+/**
+ * @brief Makes a system call without the wrapper of the C library.
+ *
+ * @param number The number of the system call.
+ * @return The result, a negative error number on failure.
+ */
+long raw_syscall(long number, long a, long b, long c, long d);
+
+/**
+ * @brief Sets the tokens of a semaphore.
+ *
+ * @param sem The semaphore.
+ * @param value The tokens.
+ */
+void semaphore_init(semaphore *sem, int value);
+
+/**
+ * @brief Takes a token of a semaphore, if there is one.
+ *
+ * @param sem The semaphore.
+ * @return true if a token was taken.
+ */
+bool semaphore_trywait(semaphore *sem);
+
+/**
+ * @brief Waits for a token of a semaphore for a while, a signal does not break the wait.
+ *
+ * @param sem The semaphore.
+ * @param timeout_us The longest wait in real microseconds, negative to wait without one.
+ * @return 0 on success, -ETIMEDOUT or another negative error number on failure.
+ */
+int semaphore_timedwait(semaphore *sem, long timeout_us);
+
+/**
+ * @brief Waits for a token of a semaphore, a signal does not break the wait.
+ *
+ * @param sem The semaphore.
+ * @return 0 on success, a negative error number on failure.
+ */
+int semaphore_wait(semaphore *sem);
+
+/**
+ * @brief Adds a token to a semaphore and wakes a waiter.
+ *
+ * @param sem The semaphore.
+ * @return 0 on success, a negative error number on failure.
+ */
+int semaphore_post(semaphore *sem);
+
+/**
+ * @brief Sleeps for a while in real time, without the wrapper of the C library.
+ *
+ * @param real_us The time in real microseconds.
+ */
+void sleep_us(long real_us);
+
+/**
+ * @brief Builds the default route network, a single line of Z stops.
+ *
+ * @param ctx The context.
+ */
+void default_routes(skibus_context *ctx);
+
+/**
+ * @brief Collects the stops where skiers can wait for a bus and the distinct lifts.
+ *
+ * @param ctx The context.
+ */
+void find_route_ends(skibus_context *ctx);
+
+/**
+ * @brief Finds the route with the fewest rides between two stops.
+ *
+ * @param ctx The context.
+ * @param from The ID of the stop the skier starts at.
+ * @param to The ID of the lift the skier goes to.
+ * @param legs The array to fill with the rides.
+ * @return Amount of rides, 0 if the lift is unreachable.
+ */
+int find_route(skibus_context *ctx, int from, int to, route_leg legs[MAX_LINES]);
+
+/**
+ * @brief Hands out the next piece of the arena, at the start of a cache line.
+ *
+ * @param arena The arena.
+ * @param size The size of the piece.
+ * @return The piece, NULL while the layout is only being measured.
+ */
+void* arena_alloc(shared_arena *arena, size_t size);
+
+/**
+ * @brief Carves the shared state of the run from the arena.
+ *
+ * @param ctx The context.
+ */
+void layout_shared(skibus_context *ctx);
+
+/**
+ * @brief Maps the arena and lays out the shared state in it.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+ */
+int init_arena(skibus_context *ctx);
+
+/**
+ * @brief Unmaps the arena.
+ *
+ * @param ctx The context.
+ */
+void destroy_arena(skibus_context *ctx);
+
+/**
+ * @brief Initializes the bus stops.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+ */
+int init_bus_stops(skibus_context *ctx);
+
+/**
+ * @brief Destroys the bus stops.
+ *
+ * @param ctx The context.
+ */
+void destroy_bus_stops(skibus_context *ctx);
+
+/**
+ * @brief Initializes the shared memory.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+ */
+int init_shared_memory(skibus_context *ctx);
+
+/**
+ * @brief Destroys the semaphores of the shared memory.
+ *
+ * @param ctx The context.
+ */
+void destroy_shared_memory(skibus_context *ctx);
+
+/**
+ * @brief Waits for my turn to access shared data.
+ *
+ * @param ctx The context.
+ */
+void wait_for_my_turn(skibus_context *ctx);
+
+/**
+ * @brief Releases my turn to access shared data.
+ *
+ * @param ctx The context.
+ */
+void done_with_my_turn(skibus_context *ctx);
+
+/**
+ * @brief Sleeps for a time in model microseconds.
+ *
+ * @param ctx The context.
+ * @param model_us The time in model microseconds.
+ */
+void model_sleep(skibus_context *ctx, long model_us);
+
+/**
+ * @brief Sleeps for a random time.
+ *
+ * @param ctx The context.
+ * @param max_value The maximum value for the random sleep time in model microseconds.
+ * @param rng The random stream of the caller.
+ * @return The slept time in model microseconds.
+ */
+long random_sleep(skibus_context *ctx, long max_value, unsigned int *rng);
+
+/**
+ * @brief Sleeps for a random travel time of the bus.
+ *
+ * @param ctx The context.
+ * @param hop The travel time of the segment.
+ * @param rng The random stream of the caller.
+ * @return The slept time in model microseconds.
+ */
+long random_hop(skibus_context *ctx, const hop_time *hop, unsigned int *rng);
+
+/**
+ * @brief Returns the real time elapsed since the start of the run in microseconds.
+ *
+ * @param ctx The context.
+ */
+long long real_elapsed_us(skibus_context *ctx);
+
+/**
+ * @brief Returns the real time elapsed since the start of the run in nanoseconds.
+ *
+ * @param ctx The context.
+ */
+long long real_elapsed_ns(skibus_context *ctx);
+
+/**
+ * @brief Returns the model time elapsed since the start of the run in microseconds.
+ *
+ * @param ctx The context.
+ */
+long long model_elapsed_us(skibus_context *ctx);
+
+/**
+ * @brief Collects the run statistics, in model time.
+ *
+ * @param ctx The context.
+ * @param stats The statistics to fill.
+ */
+void collect_statistics(skibus_context *ctx, skibus_stats *stats);
+
+/**
+ * @brief Waits for my turn to access the counters of a line.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ */
+void lock_line(skibus_context *ctx, int line);
+
+/**
+ * @brief Releases my turn to access the counters of a line.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ */
+void unlock_line(skibus_context *ctx, int line);
+
+/**
+ * @brief Waits on a handshake semaphore with the selected wait strategy.
+ *
+ * @param ctx The context.
+ * @param sem The semaphore.
+ * @param spin The spin state of the wait point.
+ * @return 0 on success, -1 on failure.
+ */
+int handshake_wait(skibus_context *ctx, semaphore *sem, spin_state *spin);
+
+/**
+ * @brief Lets n skiers through and waits until the last one is done.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param stop The semaphore the skiers wait on, if they are not given one by one.
+ * @param queue The skiers to wake up each on its own semaphore, NULL to use the stop.
+ * @param n The amount of skiers to let through.
+ */
+void release_and_wait(skibus_context *ctx, int line, semaphore *stop, const int *queue, int n);
+
+/**
+ * @brief Puts a skier at the end of the queue of a stop.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param position The position of the stop on the line.
+ * @param idL The index of the skier.
+ */
+void queue_skier(skibus_context *ctx, int line, int position, int idL);
+
+/**
+ * @brief Takes the skiers with the oldest tickets from the queue of a stop.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param position The position of the stop on the line.
+ * @param queue The array to fill with the skiers.
+ * @param n The amount of skiers to take.
+ */
+void dequeue_skiers(skibus_context *ctx, int line, int position, int *queue, int n);
+
+/**
+ * @brief Records the boarding wait of a skier.
+ *
+ * @param ctx The context.
+ * @param idL The index of the skier.
+ */
+void record_wait(skibus_context *ctx, int idL);
+
+/**
+ * @brief Returns the upper bound of a boarding wait percentile.
+ *
+ * @param ctx The context.
+ * @param percentile The percentile in the interval (0, 1>.
+ * @return The upper bound in model microseconds.
+ */
+long long wait_percentile(skibus_context *ctx, double percentile);
+
+/**
+ * @brief Function called by a skier, that is done boarding or leaving the bus.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ */
+void done_at_stop(skibus_context *ctx, int line);
+
+/**
+ * @brief Adds a visit of the bus to the report of its line, called when the bus leaves a stop.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param position The position of the stop on the line.
+ * @param alighted The amount of skiers, that got off.
+ * @param boarded The amount of skiers, that got on.
+ * @param left_behind The amount of skiers, that did not fit on the bus.
+ */
+void record_departure(skibus_context *ctx, int line, int position, int alighted, int boarded, int left_behind);
+
+/**
+ * @brief Hands an event to the main process.
+ *
+ * @param ctx The context.
+ * @param type What happened.
+ * @param line The index of the line of a bus event, -1 for a skier.
+ * @param idL The ID of the skier, 0 for a bus.
+ * @param idZ The ID of the bus stop, 0 if none.
+ */
+void log_event(skibus_context *ctx, skibus_event_type type, int line, int idL, int idZ);
+
+/**
+ * @brief Function called when the bus starts its journey.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ */
+void bus_started(skibus_context *ctx, int line);
+
+/**
+ * @brief Function called when the bus arrives at a bus stop.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param idZ The ID of the bus stop.
+ */
+void bus_arrived(skibus_context *ctx, int line, int idZ);
+
+/**
+ * @brief Function called when the bus leaves a bus stop.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param idZ The ID of the bus stop.
+ */
+void bus_leaving(skibus_context *ctx, int line, int idZ);
+
+/**
+ * @brief Function called when the bus arrives at the final stop.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ */
+void bus_arrived_to_final(skibus_context *ctx, int line);
+
+/**
+ * @brief Function called when the bus leaves the final stop.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ */
+void bus_leaving_final(skibus_context *ctx, int line);
+
+/**
+ * @brief Function called when the bus finishes its journey.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ */
+void bus_finished(skibus_context *ctx, int line);
+
+/**
+ * @brief Function called when a skier starts skiing.
+ *
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ */
+void skier_started(skibus_context *ctx, int idL);
+
+/**
+ * @brief Function called when a skier arrives at a bus stop.
+ *
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ * @param idZ The ID of the bus stop.
+ */
+void skier_arrived(skibus_context *ctx, int idL, int idZ);
+
+/**
+ * @brief Function called when a skier is boarding the bus.
+ *
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ * @param idZ The ID of the bus stop.
+ */
+void skier_boarding(skibus_context *ctx, int idL, int idZ);
+
+/**
+ * @brief Function called when a skier gets off to change lines.
+ *
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ * @param idZ The ID of the bus stop.
+ */
+void skier_transferring(skibus_context *ctx, int idL, int idZ);
+
+/**
+ * @brief Function called when a skier reaches the sky.
+ *
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ * @param idZ The ID of the stop at the lift.
+ */
+void skier_sky(skibus_context *ctx, int idL, int idZ);
+
+/**
+ * @brief Takes the oldest event from the ring and hands it to the event callback.
+ *
+ * @param ctx The context.
+ */
+void deliver_event(skibus_context *ctx);
+
+/**
+ * @brief Hands the waiting events to the event callback.
+ *
+ * @param ctx The context.
+ */
+void drain_events(skibus_context *ctx);
+
+/**
+ * @brief Waits for an event for a while, then hands all waiting events to the event callback.
+ *
+ * @param ctx The context.
+ * @param timeout_us The longest wait in real microseconds.
+ */
+void wait_for_events(skibus_context *ctx, long timeout_us);
+
+/**
+ * @brief Returns a random number from a random stream.
+ *
+ * @param rng The random stream of the caller.
+ */
+int random_number(unsigned int *rng);
+
+/**
+ * @brief Returns a random number in the interval <0, 1).
+ *
+ * @param rng The random stream of the caller.
+ */
+double random_unit(unsigned int *rng);
+
+/**
+ * @brief Orders the arrivals by time, for qsort.
+ */
+int compare_arrivals(const void *a, const void *b);
+
+/**
+ * @brief Generates the first arrival of every skier according to the arrival profile.
+ *
+ * @param ctx The context.
+ */
+void generate_arrivals(skibus_context *ctx);
+
+/**
+ * @brief Initializes the arrival schedule.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+ */
+int init_arrivals(skibus_context *ctx);
+
+/**
+ * @brief Destroys the arrival schedule.
+ *
+ * @param ctx The context.
+ */
+void destroy_arrivals(skibus_context *ctx);
+
+/**
+ * @brief Creates the process, that releases the arrivals from the schedule.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+ */
+int craete_injector_process(skibus_context *ctx);
+
+/**
+ * @brief Picks the stop and a random reachable lift for the next lap of a skier.
+ *
+ * @param ctx The context.
+ * @param idL The index of the skier.
+ */
+void skier_plan_lap(skibus_context *ctx, int idL);
+
+/**
+ * @brief Takes a skier one phase further.
+ *
+ * @param ctx The context.
+ * @param idL The index of the skier.
+ */
+void skier_step(skibus_context *ctx, int idL);
+
+/**
+ * @brief Runs a skier until it is done for the day.
+ *
+ * @param arg The skier_worker_arg of the skier.
+ * @return The exit status of the skier.
+ */
+int skier_worker(void *arg);
+
+/**
+ * @brief Creates processes for skiers.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+ */
+int create_skiers_processes(skibus_context *ctx);
+
+/**
+ * @brief Unmaps the stacks of the cloned skiers.
+ *
+ * @param ctx The context.
+ */
+void destroy_skier_stacks(skibus_context *ctx);
+
+/**
+ * @brief Adds the memory of a process to a sample.
+ *
+ * @param pid The process, 0 for the calling one.
+ * @param usage The sample to add to.
+ * @return 0 on success, -1 if the process is gone.
+ */
+int read_process_memory(pid_t pid, memory_usage *usage);
+
+/**
+ * @brief Samples the memory of the main process, its workers and the kernel.
+ *
+ * @param ctx The context.
+ * @param usage The sample to fill.
+ */
+void sample_memory(skibus_context *ctx, memory_usage *usage);
+
+/**
+ * @brief Samples the memory and raises the peaks.
+ *
+ * @param ctx The context.
+ */
+void track_memory_peak(skibus_context *ctx);
+
+/**
+ * @brief Returns the memory every skier has added at the peak.
+ *
+ * @param ctx The context.
+ * @return The memory per skier in KiB, 0 without skiers.
+ */
+double memory_per_skier_kb(skibus_context *ctx);
+
+/**
+ * @brief Creates a process for the ski bus of a line.
+ *
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @return 0 on success, -1 on failure.
+ */
+int craete_ski_bus_process(skibus_context *ctx, int line);
+
+/**
+ * @brief Takes note of a new worker.
+ *
+ * @param ctx The context.
+ * @param id The process of the worker.
+ * @param own_memory The worker has an address space of its own.
+ */
+void add_worker(skibus_context *ctx, pid_t id, bool own_memory);
+
+/**
+ * @brief Waits for the workers, that have exited.
+ *
+ * @param ctx The context.
+ * @param block Wait until all of them have exited.
+ * @return 0 if all exited fine, -1 if one has failed.
+ */
+int reap_workers(skibus_context *ctx, bool block);
+
+/**
+ * @brief Kills and waits for all the workers, that are left.
+ *
+ * @param ctx The context.
+ */
+void kill_workers(skibus_context *ctx);
+
+/**
+ * @brief Hands out the events, takes the checkpoints and samples the memory, until the workers are done.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 if a worker has failed.
+ */
+int supervise(skibus_context *ctx);
+
+/**
+ * @brief Takes a semaphore in the main process, handing out events while it waits.
+ *
+ * @param ctx The context.
+ * @param sem The semaphore.
+ * @return 0 on success, -1 if a worker has failed.
+ */
+int lock_draining(skibus_context *ctx, semaphore *sem);
+
+/**
+ * @brief Writes the simulation state to a checkpoint file.
+ *
+ * @param ctx The context.
+ * @param file_name The checkpoint file.
+ * @return 0 on success, -1 if the file could not be written, -2 if a worker has died.
+ */
+int write_checkpoint(skibus_context *ctx, const char *file_name);
+
+/**
+ * @brief Checks the arguments of a run, from the configuration or a checkpoint.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 if one is out of range.
+ */
+int check_arguments(skibus_context *ctx);
+
+/**
+ * @brief Checks the route network taken over from a checkpoint.
+ *
+ * @param ctx The context.
+ * @return 0 on success, -1 if it is out of range.
+ */
+int check_routes(skibus_context *ctx);
+
+/**
+ * @brief Checks the bus lines, skiers and arrivals of a mapped checkpoint.
+ *
+ * @param ctx The context.
+ * @param header The mapped checkpoint.
+ * @return 0 on success, -1 if they are out of range.
+ */
+int check_checkpoint_state(skibus_context *ctx, const checkpoint_header *header);
+
+/**
+ * @brief Maps a checkpoint file and takes over its configuration.
+ *
+ * @param ctx The context.
+ * @param file_name The checkpoint file.
+ * @param size Filled with the size of the mapping.
+ * @return The mapped checkpoint, NULL if it is invalid.
+ */
+checkpoint_header* load_checkpoint(skibus_context *ctx, const char *file_name, size_t *size);
+
+/**
+ * @brief Orders skier indices by their tickets, for qsort_r.
+ */
+int compare_tickets(const void *a, const void *b, void *skiers);
+
+/**
+ * @brief Restores the simulation state from a mapped checkpoint.
+ *
+ * @param ctx The context.
+ * @param header The mapped checkpoint.
+ * @return 0 on success, -1 on failure.
+ */
+int restore_checkpoint(skibus_context *ctx, checkpoint_header *header);
+
+/**
+ * @brief Resolves the capacities and the segment travel times of the configuration for every line.
+ *
+ * @param ctx The context, with the route network in place.
+ * @param config The configuration.
+ * @return 0 on success, -1 if the scenario does not fit the network.
+ */
+int resolve_scenario(skibus_context *ctx, const skibus_config *config);
+
+/**
+ * @brief Takes over the configuration of a run and checks it.
+ *
+ * @param ctx The context.
+ * @param config The configuration.
+ * @return 0 on success, -1 if it is invalid.
+ */
+int configure(skibus_context *ctx, const skibus_config *config);
+
+#endif
@@ -0,0 +1,2513 @@
+/** AUTHOR
+_______________________________
+
+ * Name: Martin Mendl
+ * Email: x247581@fit.vutbr.cz
+ * Date: 26.4. 2024
+ * file: libskibus, the ski bus simulation library
+_______________________________
+*/
+
+
+#define _GNU_SOURCE
+
+#include "skibus-internal.h"
+
+/**
+ * @brief Records the reason of a failure of the main process.
+ * @param ctx The context.
+ * @param message The reason.
+ * @return -1, for returning it.
+*/
+int set_error(skibus_context *ctx, const char *message) {
+    snprintf(ctx->error, sizeof(ctx->error), "%s", message);
+    return -1;
+}
+
+/**
+ * @brief Ends a worker, that has failed. Only the first failure is kept, the main process
+ * picks it up once it sees the worker exit. The error comes with the call, since a cloned
+ * skier has no errno of its own, and it is only turned into text by the main process,
+ * a cloned skier calls nothing of the C library, that could use its thread local storage.
+ * @param ctx The context.
+ * @param message The reason.
+ * @param error The negative error number of the failed call.
+*/
+void worker_fail(skibus_context *ctx, const char *message, int error) {
+    run_channel *channel = ctx->channel;
+
+    if (__atomic_exchange_n(&channel->failed, 1, __ATOMIC_ACQ_REL) == 0) {
+        int length = 0;
+        while (message[length] != '\0' && length < MAX_ERROR_LENGTH - 1) {
+            channel->error[length] = message[length];
+            length++;
+        }
+        channel->error[length] = '\0';
+        channel->error_number = -error;
+    }
+
+    // never run the exit handlers or flush the stdio buffers of the caller
+    raw_syscall(SYS_exit_group, EXIT_FAILURE, 0, 0, 0);
+    __builtin_unreachable();
+}
+
+/**
+ * @brief Ends a worker, that is done, the last one lets the main process know the run is over.
+ * @param ctx The context.
+*/
+void worker_exit(skibus_context *ctx) {
+    __atomic_sub_fetch(&ctx->channel->workers_running, 1, __ATOMIC_RELEASE);
+    raw_syscall(SYS_exit_group, EXIT_SUCCESS, 0, 0, 0);
+    __builtin_unreachable();
+}
+
+/**
+ * @brief Makes a system call straight, without the wrapper of the C library, which sets errno
+ * on a failure and, for a wait, the cancellation state of the calling thread. A cloned skier
+ * has neither of its own, it shares the thread local storage of the caller of skibus_run.
+ * @param number The number of the system call.
+ * @param a The first argument.
+ * @param b The second argument.
+ * @param c The third argument.
+ * @param d The fourth argument.
+ * @return The result, a negative error number on failure.
+*/
+long raw_syscall(long number, long a, long b, long c, long d) {
+#if defined(__x86_64__)
+    register long r10 __asm__("r10") = d;
+    long result;
+    __asm__ volatile ("syscall" : "=a"(result) : "a"(number), "D"(a), "S"(b), "d"(c), "r"(r10) : "rcx", "r11", "memory");
+    return result;
+#elif defined(__aarch64__)
+    register long x8 __asm__("x8") = number;
+    register long x0 __asm__("x0") = a;
+    register long x1 __asm__("x1") = b;
+    register long x2 __asm__("x2") = c;
+    register long x3 __asm__("x3") = d;
+    __asm__ volatile ("svc 0" : "+r"(x0) : "r"(x8), "r"(x1), "r"(x2), "r"(x3) : "memory", "cc");
+    return x0;
+#endif
+}
+
+/**
+ * @brief Sets the tokens of a semaphore, nobody may wait on it yet.
+ * @param sem The semaphore.
+ * @param value The tokens.
+*/
+void semaphore_init(semaphore *sem, int value) {
+    sem->value = value;
+    sem->sleepers = 0;
+}
+
+/**
+ * @brief Takes a token of a semaphore, if there is one.
+ * @param sem The semaphore.
+ * @return true if a token was taken.
+*/
+bool semaphore_trywait(semaphore *sem) {
+    int value = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+    while (value > 0) {
+        if (__atomic_compare_exchange_n(&sem->value, &value, value - 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Waits for a token of a semaphore for a while, parked on the futex of its value. The
+ * waiter counts itself as a sleeper before it checks the value one last time, and a post adds
+ * the token before it checks for sleepers, so one of them always sees the other.
+ * @param sem The semaphore.
+ * @param timeout_us The longest wait in real microseconds, negative to wait without one.
+ * @return 0 on success, -ETIMEDOUT or another negative error number on failure.
+*/
+int semaphore_timedwait(semaphore *sem, long timeout_us) {
+    struct timespec timeout = { timeout_us / 1000000, timeout_us % 1000000 * 1000 };
+
+    while (!semaphore_trywait(sem)) {
+        long result = 0;
+
+        __atomic_fetch_add(&sem->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&sem->value, __ATOMIC_SEQ_CST) == 0)
+            result = raw_syscall(SYS_futex, (long)&sem->value, FUTEX_WAIT, 0, timeout_us < 0 ? 0 : (long)&timeout);
+        __atomic_fetch_sub(&sem->sleepers, 1, __ATOMIC_SEQ_CST);
+
+        // a signal restarts the whole timeout, the timeout only bounds how long the caller sleeps
+        if (result == -ETIMEDOUT)
+            return semaphore_trywait(sem) ? 0 : -ETIMEDOUT;
+        if (result < 0 && result != -EINTR && result != -EAGAIN)
+            return result;
+    }
+    return 0;
+}
+
+/**
+ * @brief Waits for a token of a semaphore, a signal of the caller does not break the wait.
+ * @param sem The semaphore.
+ * @return 0 on success, a negative error number if the semaphore failed.
+*/
+int semaphore_wait(semaphore *sem) {
+    return semaphore_timedwait(sem, -1);
+}
+
+/**
+ * @brief Adds a token to a semaphore, a waiter is only woken up, when one sleeps.
+ * @param sem The semaphore.
+ * @return 0 on success, a negative error number if the semaphore failed.
+*/
+int semaphore_post(semaphore *sem) {
+    __atomic_fetch_add(&sem->value, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sem->sleepers, __ATOMIC_SEQ_CST) == 0)
+        return 0;
+
+    long result = raw_syscall(SYS_futex, (long)&sem->value, FUTEX_WAKE, 1, 0);
+    return result < 0 ? result : 0;
+}
+
+/**
+ * @brief Sleeps for a while in real time, a signal does not cut the sleep short.
+ * @param real_us The time in real microseconds.
+*/
+void sleep_us(long real_us) {
+    struct timespec left = { real_us / 1000000, real_us % 1000000 * 1000 };
+
+    while (raw_syscall(SYS_nanosleep, (long)&left, (long)&left, 0, 0) == -EINTR)
+        ;
+}
+
+/**
+ * @brief Fills in the configuration of the command line defaults.
+ * @param config The configuration.
+*/
+void skibus_default_config(skibus_config *config) {
+    memset(config, 0, sizeof(*config));
+    config->time_scale = 1.0;
+    config->laps = 1;
+}
+
+/**
+ * @brief Builds the default route network, a single line of Z stops with the final one at the lift.
+ * @param ctx The context.
+*/
+void default_routes(skibus_context *ctx) {
+    ctx->route_count = 1;
+    ctx->routes[0].length = ctx->Z;
+    for (int i = 0; i < ctx->Z; i++)
+        ctx->routes[0].stops[i] = i + 1;
+}
+
+/**
+ * @brief Loads the route network, each non empty line of the file lists the stop IDs of one bus line.
+ * The last stop of a line is its terminal at a lift, '#' starts a comment.
+ * @param config The configuration to load the network into.
+ * @param file_name The route network file.
+ * @return 0 on success, -1 if the file is invalid.
+*/
+int skibus_load_routes(skibus_config *config, const char *file_name) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL)
+        return -1;
+
+    char buffer[256];
+    config->line_count = 0;
+
+    while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        char *comment = strchr(buffer, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        route_line line = { .length = 0 };
+        char *token = strtok(buffer, " \t\r\n");
+
+        for (; token != NULL; token = strtok(NULL, " \t\r\n")) {
+            char *endptr;
+            long stop = strtol(token, &endptr, 10);
+            if (*endptr != '\0' || stop < 1 || stop > MAX_STOPS || line.length == MAX_LINE_STOPS) {
+                fclose(file);
+                return -1;
+            }
+            line.stops[line.length++] = stop;
+        }
+
+        // empty line
+        if (line.length == 0)
+            continue;
+
+        // a line needs a stop to board at and a terminal
+        if (line.length < 2 || config->line_count == MAX_LINES) {
+            fclose(file);
+            return -1;
+        }
+        config->lines[config->line_count++] = line;
+    }
+
+    fclose(file);
+    return config->line_count > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Loads a scenario, each non empty line of the file is one of
+ *   capacity LINE K                      the bus of line LINE, counted from 1, takes K skiers
+ *   segment FROM TO uniform MIN MAX      travelling from stop FROM to stop TO takes MIN to MAX
+ *   segment FROM TO fixed T              it always takes T
+ *   segment FROM TO exp MIN MEAN MAX     it takes MIN plus an exponential with the mean MEAN, at most MAX
+ * with the times in model microseconds, '#' starts a comment. The values are checked against
+ * the route network once the run starts.
+ * @param config The configuration to load the scenario into.
+ * @param file_name The scenario file.
+ * @return 0 on success, -1 if the file is invalid.
+*/
+int skibus_load_scenario(skibus_config *config, const char *file_name) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL)
+        return -1;
+
+    char buffer[256];
+    bool valid = true;
+    memset(config->capacities, 0, sizeof(config->capacities));
+    config->segment_count = 0;
+
+    while (valid && fgets(buffer, sizeof(buffer), file) != NULL) {
+        char *comment = strchr(buffer, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        // the keyword, the distribution of a segment and up to five numbers
+        char *keyword = strtok(buffer, " \t\r\n"), *kind = NULL;
+        long values[5];
+        int count = 0;
+
+        // empty line
+        if (keyword == NULL)
+            continue;
+
+        for (char *token = strtok(NULL, " \t\r\n"); valid && token != NULL; token = strtok(NULL, " \t\r\n")) {
+            char *endptr;
+            if (count == 2 && kind == NULL && strcmp(keyword, "segment") == 0) {
+                kind = token;
+                continue;
+            }
+            if (count == 5) {
+                valid = false;
+                break;
+            }
+            values[count++] = strtol(token, &endptr, 10);
+            valid = *endptr == '\0';
+        }
+        if (!valid)
+            break;
+
+        if (strcmp(keyword, "capacity") == 0) {
+            valid = count == 2 && values[0] >= 1 && values[0] <= MAX_LINES;
+            if (valid)
+                config->capacities[values[0] - 1] = values[1];
+            continue;
+        }
+
+        valid = strcmp(keyword, "segment") == 0 && kind != NULL && config->segment_count < SKIBUS_MAX_SEGMENTS;
+        if (!valid)
+            break;
+
+        skibus_segment *segment = &config->segments[config->segment_count++];
+        *segment = (skibus_segment){ .from = values[0], .to = values[1], .kind = SKIBUS_TRAVEL_UNIFORM };
+        if (strcmp(kind, "uniform") == 0 && count == 4) {
+            segment->min_us = values[2];
+            segment->max_us = values[3];
+        } else if (strcmp(kind, "fixed") == 0 && count == 3) {
+            segment->min_us = segment->max_us = values[2];
+        } else if (strcmp(kind, "exp") == 0 && count == 5) {
+            segment->kind = SKIBUS_TRAVEL_EXPONENTIAL;
+            segment->min_us = values[2];
+            segment->mean_us = values[3];
+            segment->max_us = values[4];
+        } else {
+            valid = false;
+        }
+    }
+
+    fclose(file);
+    return valid ? 0 : -1;
+}
+
+/**
+ * @brief Collects the stops where skiers can wait for a bus and the distinct lifts.
+ * @param ctx The context.
+*/
+void find_route_ends(skibus_context *ctx) {
+    bool origin[MAX_STOPS + 1] = { false }, lift[MAX_STOPS + 1] = { false };
+
+    for (int line = 0; line < ctx->route_count; line++) {
+        for (int i = 0; i < ctx->routes[line].length - 1; i++)
+            origin[ctx->routes[line].stops[i]] = true;
+        lift[ctx->routes[line].stops[ctx->routes[line].length - 1]] = true;
+    }
+
+    ctx->route_origin_count = ctx->route_lift_count = 0;
+    for (int stop = 1; stop <= MAX_STOPS; stop++) {
+        if (origin[stop])
+            ctx->route_origins[ctx->route_origin_count++] = stop;
+        if (lift[stop])
+            ctx->route_lifts[ctx->route_lift_count++] = stop;
+    }
+}
+
+/**
+ * @brief Breadth first search over the stops, one step is one ride on a line.
+ * A ride always goes forward on the line, since everybody gets off at its terminal.
+ * @param ctx The context.
+ * @param from The ID of the stop the skier starts at.
+ * @param to The ID of the lift the skier goes to.
+ * @param legs The array to fill with the rides.
+ * @return Amount of rides, 0 if the lift is unreachable.
+*/
+int find_route(skibus_context *ctx, int from, int to, route_leg legs[MAX_LINES]) {
+    route_line *routes = ctx->routes;
+    route_leg reached_by[MAX_STOPS + 1];
+    int previous[MAX_STOPS + 1];
+    int queue[MAX_STOPS + 1];
+    int head = 0, tail = 0;
+
+    for (int i = 0; i <= MAX_STOPS; i++)
+        previous[i] = -1;
+
+    previous[from] = from;
+    queue[tail++] = from;
+
+    while (head < tail && previous[to] < 0) {
+        int stop = queue[head++];
+
+        for (int line = 0; line < ctx->route_count; line++) {
+            for (int board = 0; board < routes[line].length - 1; board++) {
+                if (routes[line].stops[board] != stop)
+                    continue;
+
+                for (int alight = board + 1; alight < routes[line].length; alight++) {
+                    int next = routes[line].stops[alight];
+                    if (previous[next] >= 0)
+                        continue;
+
+                    previous[next] = stop;
+                    reached_by[next] = (route_leg){ line, board, alight };
+                    queue[tail++] = next;
+                }
+            }
+        }
+    }
+
+    if (previous[to] < 0 || from == to)
+        return 0;
+
+    // walk the route backwards, then reverse it
+    int count = 0;
+    for (int stop = to; stop != from; stop = previous[stop])
+        legs[count++] = reached_by[stop];
+
+    for (int i = 0; i < count / 2; i++) {
+        route_leg tmp = legs[i];
+        legs[i] = legs[count - 1 - i];
+        legs[count - 1 - i] = tmp;
+    }
+    return count;
+}
+
+/**
+ * @brief Hands out the next piece of the arena. Every piece starts on a cache line, so two of
+ * them never share one.
+ * @param arena The arena.
+ * @param size The size of the piece.
+ * @return The piece, NULL while the layout is only being measured.
+*/
+void* arena_alloc(shared_arena *arena, size_t size) {
+    size_t offset = (arena->used + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    arena->used = offset + size;
+    return arena->base != NULL ? arena->base + offset : NULL;
+}
+
+/**
+ * @brief Carves the shared state of the run from the arena. The hot pieces come first and each
+ * lock gets a line of its own, the arrays of the skiers follow. The arrays are not padded per
+ * skier, a skier is asleep most of the time and padding them would cost every skier memory.
+ * @param ctx The context.
+*/
+void layout_shared(skibus_context *ctx) {
+    shared_arena *arena = &ctx->arena;
+    long L = ctx->L;
+
+    ctx->shared_memory = arena_alloc(arena, sizeof(shared_data));
+    ctx->channel = arena_alloc(arena, sizeof(run_channel));
+    ctx->datafor = arena_alloc(arena, sizeof(semaphore));
+    ctx->printafor = arena_alloc(arena, sizeof(semaphore));
+    ctx->bus_lines = arena_alloc(arena, sizeof(bus_line)*ctx->route_count);
+    ctx->skiers = arena_alloc(arena, sizeof(skier_state)*(L + 1));
+    ctx->skier_wakes = arena_alloc(arena, sizeof(semaphore)*(L + 1));
+
+    if (ctx->arrival_profile != SKIBUS_ARRIVALS_NONE) {
+        ctx->arrival_schedule = arena_alloc(arena, sizeof(arrival)*(L + 1));
+        ctx->skier_arrivals = arena_alloc(arena, sizeof(skier_arrival)*(L + 1));
+    }
+}
+
+/**
+ * @brief Maps the arena in one piece and lays out the shared state in it. The layout is measured
+ * first, then carved from the mapping. Reserved huge pages are tried first when asked for, then
+ * transparent ones, a kernel without either just leaves the arena on regular pages.
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+*/
+int init_arena(skibus_context *ctx) {
+    shared_arena *arena = &ctx->arena;
+    size_t page = ctx->huge_pages != SKIBUS_PAGES_NORMAL ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    void *base = MAP_FAILED;
+
+    *arena = (shared_arena){ NULL, 0, 0, SKIBUS_PAGES_NORMAL };
+    layout_shared(ctx);
+    arena->size = (arena->used + page - 1) / page * page;
+
+    if (ctx->huge_pages == SKIBUS_PAGES_HUGETLB) {
+        base = mmap(NULL, arena->size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED)
+            arena->backing = SKIBUS_PAGES_HUGETLB;
+    }
+
+    if (base == MAP_FAILED) {
+        base = mmap(NULL, arena->size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            arena->size = 0;
+            return set_error(ctx, "mapping of the shared memory failed");
+        }
+        if (ctx->huge_pages != SKIBUS_PAGES_NORMAL && madvise(base, arena->size, MADV_HUGEPAGE) == 0)
+            arena->backing = SKIBUS_PAGES_TRANSPARENT;
+    }
+
+    arena->base = base;
+    arena->used = 0;
+    layout_shared(ctx);
+    return 0;
+}
+
+/**
+ * @brief Unmaps the arena, the pieces of it have to be destroyed already.
+ * @param ctx The context.
+*/
+void destroy_arena(skibus_context *ctx) {
+    if (ctx->arena.base != NULL)
+        munmap(ctx->arena.base, ctx->arena.size);
+    ctx->arena.base = NULL;
+    ctx->arena.size = ctx->arena.used = 0;
+}
+
+/**
+ * @brief Initializes the bus lines, every stop of every line gets its own semaphores.
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+*/
+int init_bus_stops(skibus_context *ctx) {
+    for (int line = 0; line < ctx->route_count; line++) {
+        bus_line *bus = &ctx->bus_lines[line];
+        bus->capacity = ctx->line_capacity[line];
+        memcpy(bus->hops, ctx->line_hops[line], sizeof(bus->hops));
+        bus->occupancy = 0;
+        bus->pending = 0;
+        bus->travel_us = 0;
+        bus->seat_us = 0;
+        bus->handoff_ns = 0;
+        bus->handoffs = 0;
+        bus->started = bus->finished = bus->at_stop = false;
+        bus->position = 0;
+        bus->rng = random_number(&ctx->main_rng);
+        bus->sign_spin = (spin_state){ MIN_SPIN, 0, 0, 0 };
+        bus->arrived_us = bus->trip_start_us = 0;
+        bus->trip_peak = 0;
+        bus->trip_full = bus->trip_left_behind = false;
+        memset(&bus->report, 0, sizeof(bus->report));
+        bus->report.length = ctx->routes[line].length;
+        bus->report.capacity = bus->capacity;
+
+        // the stops are closed until the bus arrives
+        for (int i = 0; i < ctx->routes[line].length; i++) {
+            bus->report.stops[i].stop = ctx->routes[line].stops[i];
+            bus->stops[i].waiting = 0;
+            bus->stops[i].alighting = 0;
+            bus->stops[i].head = bus->stops[i].tail = -1;
+            semaphore_init(&bus->stops[i].alight, 0);
+        }
+
+        // Initialize the semaphore for the bus stop sign and for the line counters
+        semaphore_init(&bus->bus_stop_sign, 1);
+        semaphore_init(&bus->lock, 1);
+    }
+
+    // Initialize the semaphores for the shared data and for the events
+    semaphore_init(ctx->datafor, 1);
+    semaphore_init(ctx->printafor, 1);
+
+    return 0;
+}
+
+/**
+ * @brief Forgets the bus lines, their semaphores go away with the arena.
+ * @param ctx The context.
+*/
+void destroy_bus_stops(skibus_context *ctx) {
+    ctx->bus_lines = NULL;
+    ctx->datafor = ctx->printafor = NULL;
+}
+
+/**
+ * @brief Initializes the shared memory.
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+*/
+int init_shared_memory(skibus_context *ctx) {
+    long L = ctx->L;
+
+    // every skier gets its own random stream
+    for (int idL = 0; idL < L; idL++) {
+        skier_state *skier = &ctx->skiers[idL];
+        skier->phase = SKIER_STARTING;
+        skier->lap = 0;
+        skier->ticket = 0;
+        skier->next = -1;
+        skier->rng = random_number(&ctx->main_rng);
+        skier->board_spin = skier->alight_spin = (spin_state){ MIN_SPIN, 0, 0, 0 };
+
+        // the skier waits here for its turn to board
+        semaphore_init(&ctx->skier_wakes[idL], 0);
+    }
+
+    // the whole ring is free
+    semaphore_init(&ctx->channel->ready, 0);
+    semaphore_init(&ctx->channel->free, EVENT_RING);
+
+    memset(ctx->shared_memory, 0, sizeof(shared_data));
+    clock_gettime(CLOCK_MONOTONIC, &ctx->shared_memory->start_time);
+    return 0;
+}
+
+/**
+ * @brief Forgets the shared memory, its semaphores go away with the arena.
+ * @param ctx The context.
+*/
+void destroy_shared_memory(skibus_context *ctx) {
+    ctx->shared_memory = NULL;
+    ctx->channel = NULL;
+    ctx->skiers = NULL;
+    ctx->skier_wakes = NULL;
+}
+
+/**
+ * @brief Waits for the shared data to be available.
+ * @param ctx The context.
+*/
+void wait_for_my_turn(skibus_context *ctx) {
+    int error = semaphore_wait(ctx->datafor);
+    if (error < 0)
+        worker_fail(ctx, "datafor faild to load", error);
+}
+
+/**
+ * @brief Frees the shared data.
+ * @param ctx The context.
+*/
+void done_with_my_turn(skibus_context *ctx) {
+    int error = semaphore_post(ctx->datafor);
+    if (error < 0)
+        worker_fail(ctx, "datafor faild to free", error);
+}
+
+/**
+ * @brief Waits for the counters of a line to be available.
+ * @param ctx The context.
+ * @param line The index of the line.
+*/
+void lock_line(skibus_context *ctx, int line) {
+    int error = semaphore_wait(&ctx->bus_lines[line].lock);
+    if (error < 0)
+        worker_fail(ctx, "line lock faild to load", error);
+}
+
+/**
+ * @brief Frees the counters of a line.
+ * @param ctx The context.
+ * @param line The index of the line.
+*/
+void unlock_line(skibus_context *ctx, int line) {
+    int error = semaphore_post(&ctx->bus_lines[line].lock);
+    if (error < 0)
+        worker_fail(ctx, "line lock faild to free", error);
+}
+
+/**
+ * @brief Lets n skiers through, then waits on the bus stop sign until the last one is done.
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param stop The semaphore the skiers wait on, if they are not given one by one.
+ * @param queue The skiers to wake up each on its own semaphore, NULL to use the stop.
+ * @param n The amount of skiers to let through.
+*/
+void release_and_wait(skibus_context *ctx, int line, semaphore *stop, const int *queue, int n) {
+    bus_line *bus = &ctx->bus_lines[line];
+
+    if (n <= 0)
+        return;
+
+    long long start = real_elapsed_ns(ctx);
+
+    lock_line(ctx, line);
+    bus->pending = n;
+    unlock_line(ctx, line);
+
+    // make the bus stop sign active
+    int error = semaphore_wait(&bus->bus_stop_sign);
+    if (error < 0)
+        worker_fail(ctx, "Bus faild to wait for skiers to baord", error);
+
+    // allow n amount of passages through
+    for (int j = 0; j < n; j++) {
+        if ((error = semaphore_post(queue != NULL ? &ctx->skier_wakes[queue[j]] : stop)) < 0)
+            worker_fail(ctx, "faild to make space on the bus", error);
+    }
+
+    // the only way this will go throw, is when the last skier would free the bus_stop_sign
+    if ((error = handshake_wait(ctx, &bus->bus_stop_sign, &bus->sign_spin)) < 0)
+        worker_fail(ctx, "Bus faild to wait for skiers to baord", error);
+
+    // free the stop sign
+    if ((error = semaphore_post(&bus->bus_stop_sign)) < 0)
+        worker_fail(ctx, "bus faild to leave the bus station", error);
+
+    bus->handoff_ns += real_elapsed_ns(ctx) - start;
+    bus->handoffs++;
+}
+
+/**
+ * @brief Puts a skier at the end of the queue of a stop and hands it a ticket. Expects the line to be locked.
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param position The position of the stop on the line.
+ * @param idL The index of the skier.
+*/
+void queue_skier(skibus_context *ctx, int line, int position, int idL) {
+    line_stop *stop = &ctx->bus_lines[line].stops[position];
+
+    ctx->skiers[idL].next = -1;
+    if (stop->tail < 0)
+        stop->head = idL;
+    else
+        ctx->skiers[stop->tail].next = idL;
+    stop->tail = idL;
+    stop->waiting++;
+}
+
+/**
+ * @brief Takes the skiers with the oldest tickets from the queue of a stop. Expects the line to be locked.
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param position The position of the stop on the line.
+ * @param queue The array to fill with the skiers.
+ * @param n The amount of skiers to take.
+*/
+void dequeue_skiers(skibus_context *ctx, int line, int position, int *queue, int n) {
+    line_stop *stop = &ctx->bus_lines[line].stops[position];
+
+    for (int j = 0; j < n; j++) {
+        queue[j] = stop->head;
+        stop->head = ctx->skiers[stop->head].next;
+    }
+    if (stop->head < 0)
+        stop->tail = -1;
+}
+
+/**
+ * @brief Records how long a skier waited at the stop, in a histogram of powers of two model microseconds.
+ * @param ctx The context.
+ * @param idL The index of the skier.
+*/
+void record_wait(skibus_context *ctx, int idL) {
+    shared_data *shared_memory = ctx->shared_memory;
+    long long waited = model_elapsed_us(ctx) - ctx->skiers[idL].queued_us;
+    int bucket = 0;
+
+    while (bucket < WAIT_BUCKETS - 1 && (1LL << bucket) <= waited)
+        bucket++;
+
+    __atomic_fetch_add(&shared_memory->wait_histogram[bucket], 1, __ATOMIC_RELAXED);
+
+    long long longest = __atomic_load_n(&shared_memory->max_wait_us, __ATOMIC_RELAXED);
+    while (waited > longest &&
+        !__atomic_compare_exchange_n(&shared_memory->max_wait_us, &longest, waited, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+ * @brief Returns the upper bound of the wait percentile from the wait histogram.
+ * @param ctx The context.
+ * @param percentile The percentile in the interval (0, 1>.
+ * @return The upper bound in model microseconds.
+*/
+long long wait_percentile(skibus_context *ctx, double percentile) {
+    shared_data *shared_memory = ctx->shared_memory;
+    long long total = 0, seen = 0;
+
+    for (int i = 0; i < WAIT_BUCKETS; i++)
+        total += shared_memory->wait_histogram[i];
+
+    for (int i = 0; i < WAIT_BUCKETS; i++) {
+        seen += shared_memory->wait_histogram[i];
+        // the bucket bound, but never above the longest wait
+        if (total > 0 && seen >= percentile * total)
+            return i == 0 ? 0 : (1LL << i) < shared_memory->max_wait_us ? 1LL << i : shared_memory->max_wait_us;
+    }
+    return 0;
+}
+
+/**
+ * @brief Waits on a handshake semaphore. With the adaptive strategy the waiter first spins on
+ * the semaphore value with an exponential pause backoff and only blocks in the kernel, when
+ * the spin budget runs out. The budget doubles while the recent waits are short enough to be
+ * caught by spinning and halves while they are not.
+ * @param ctx The context.
+ * @param sem The semaphore.
+ * @param spin The spin state of this wait point.
+ * @return 0 on success, -1 if the semaphore failed.
+*/
+int handshake_wait(skibus_context *ctx, semaphore *sem, spin_state *spin) {
+    if (ctx->wait_strategy == SKIBUS_WAIT_BLOCK)
+        return semaphore_wait(sem);
+
+    long long start = real_elapsed_ns(ctx);
+    int result = -1;
+
+    for (int i = 0, backoff = 1; i < spin->limit; i += backoff, backoff = backoff < MAX_BACKOFF ? backoff * 2 : backoff) {
+        if (semaphore_trywait(sem)) {
+            result = 0;
+            spin->hits++;
+            break;
+        }
+        for (int j = 0; j < backoff; j++)
+            cpu_relax();
+    }
+
+    if (result < 0) {
+        spin->blocks++;
+        result = semaphore_wait(sem);
+    }
+
+    long long waited = real_elapsed_ns(ctx) - start;
+    spin->average_ns += (waited - spin->average_ns) / 8;
+
+    if (spin->average_ns < SPIN_BUDGET_NS)
+        spin->limit = spin->limit * 2 < MAX_SPIN ? spin->limit * 2 : MAX_SPIN;
+    else
+        spin->limit = spin->limit / 2 > MIN_SPIN ? spin->limit / 2 : MIN_SPIN;
+
+    return result;
+}
+
+/**
+ * @brief Takes note of a skier, that is done at the stop, the last one tells the bus to leave.
+ * Expects the line to be locked, unlocks it.
+ * @param ctx The context.
+ * @param line The index of the line.
+*/
+void done_at_stop(skibus_context *ctx, int line) {
+    int data_buffer = --ctx->bus_lines[line].pending;
+    unlock_line(ctx, line);
+
+    // I am the last one
+    if (data_buffer == 0) {
+        // tell the bus to leave
+        int error = semaphore_post(&ctx->bus_lines[line].bus_stop_sign);
+        if (error < 0)
+            worker_fail(ctx, "bus faild to leave the bus station", error);
+    }
+}
+
+/**
+ * @brief Adds a visit of the bus to the report of its line, together with the trip it is on.
+ * Leaving the final stop finishes the trip. Expects the line to be locked.
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param position The position of the stop on the line.
+ * @param alighted The amount of skiers, that got off.
+ * @param boarded The amount of skiers, that got on.
+ * @param left_behind The amount of skiers, that did not fit on the bus.
+*/
+void record_departure(skibus_context *ctx, int line, int position, int alighted, int boarded, int left_behind) {
+    bus_line *bus = &ctx->bus_lines[line];
+    skibus_stop_stats *stop = &bus->report.stops[position];
+    long long now_us = model_elapsed_us(ctx);
+
+    stop->visits++;
+    if (alighted == 0 && boarded == 0)
+        stop->empty_visits++;
+    stop->boarded += boarded;
+    stop->alighted += alighted;
+    stop->left_behind += left_behind;
+    stop->load_sum += bus->occupancy;
+    if (bus->occupancy > stop->max_load)
+        stop->max_load = bus->occupancy;
+    stop->dwell_us += now_us - bus->arrived_us;
+
+    if (bus->occupancy > bus->trip_peak)
+        bus->trip_peak = bus->occupancy;
+    bus->trip_full |= bus->occupancy == bus->capacity;
+    bus->trip_left_behind |= left_behind > 0;
+
+    if (position < ctx->routes[line].length - 1)
+        return;
+
+    bus->report.trips++;
+    bus->report.trip_us += now_us - bus->trip_start_us;
+    bus->report.peak_load_sum += bus->trip_peak;
+    bus->report.full_trips += bus->trip_full;
+    bus->report.left_behind_trips += bus->trip_left_behind;
+
+    bus->trip_start_us = now_us;
+    bus->trip_peak = 0;
+    bus->trip_full = bus->trip_left_behind = false;
+}
+
+/**
+ * @brief Generates a random sleep time.
+ * @param ctx The context.
+ * @param max_value The maximum sleep time in model microseconds.
+ * @param rng The random stream of the caller.
+ * @return The slept time in model microseconds.
+*/
+long random_sleep(skibus_context *ctx, long max_value, unsigned int *rng) {
+    // a single random number is too narrow for model times in minutes
+    long long wide_rand = ((long long)random_number(rng) << 31) | random_number(rng);
+    long sleep_time = wide_rand % (max_value + 1);
+
+    model_sleep(ctx, sleep_time);
+    return sleep_time;
+}
+
+/**
+ * @brief Sleeps for a time in model microseconds, scaled down to real time.
+ * @param ctx The context.
+ * @param model_us The time in model microseconds.
+*/
+void model_sleep(skibus_context *ctx, long model_us) {
+    double real_sleep = model_us / ctx->time_scale;
+    if (real_sleep < SLEEP_FLOOR_US)
+        raw_syscall(SYS_sched_yield, 0, 0, 0, 0);
+    else
+        sleep_us(real_sleep);
+}
+
+/**
+ * @brief Sleeps for a random travel time of the bus, drawn from the distribution of the segment.
+ * A segment without a scenario is uniform over <0, TB>, the same draw as random_sleep.
+ * @param ctx The context.
+ * @param hop The travel time of the segment.
+ * @param rng The random stream of the caller.
+ * @return The slept time in model microseconds.
+*/
+long random_hop(skibus_context *ctx, const hop_time *hop, unsigned int *rng) {
+    if (hop->kind == SKIBUS_TRAVEL_UNIFORM)
+        return hop->min_us + random_sleep(ctx, hop->max_us - hop->min_us, rng);
+
+    double tail = -log(1.0 - random_unit(rng)) * hop->mean_us;
+    long sleep_time = hop->min_us + tail < hop->max_us ? hop->min_us + (long)tail : hop->max_us;
+
+    model_sleep(ctx, sleep_time);
+    return sleep_time;
+}
+
+/**
+ * @brief Returns the real time elapsed since the start of the run.
+ * @param ctx The context.
+*/
+long long real_elapsed_us(skibus_context *ctx) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - ctx->shared_memory->start_time.tv_sec) * 1000000LL +
+           (now.tv_nsec - ctx->shared_memory->start_time.tv_nsec) / 1000;
+}
+
+/**
+ * @brief Returns the real time elapsed since the start of the run in nanoseconds.
+ * @param ctx The context.
+*/
+long long real_elapsed_ns(skibus_context *ctx) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - ctx->shared_memory->start_time.tv_sec) * 1000000000LL +
+           (now.tv_nsec - ctx->shared_memory->start_time.tv_nsec);
+}
+
+/**
+ * @brief Returns the model time elapsed since the start of the run.
+ * @param ctx The context.
+*/
+long long model_elapsed_us(skibus_context *ctx) {
+    return real_elapsed_us(ctx) * ctx->time_scale;
+}
+
+/**
+ * @brief Collects the run statistics, all times are in model time.
+ * @param ctx The context.
+ * @param stats The statistics to fill.
+*/
+void collect_statistics(skibus_context *ctx, skibus_stats *stats) {
+    shared_data *shared_memory = ctx->shared_memory;
+    long long real_us = real_elapsed_us(ctx);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->events = shared_memory->ID;
+    stats->skiers_transported = shared_memory->skiers_finished;
+    stats->time_scale = ctx->time_scale;
+    stats->model_time_us = real_us * ctx->time_scale;
+    stats->real_time_us = real_us;
+
+    long long seat_us = 0, capacity_us = 0;
+    for (int line = 0; line < ctx->route_count; line++) {
+        stats->bus_travel_us += ctx->bus_lines[line].travel_us;
+        capacity_us += ctx->bus_lines[line].capacity * ctx->bus_lines[line].travel_us;
+        seat_us += ctx->bus_lines[line].seat_us;
+        stats->handoff_ns += ctx->bus_lines[line].handoff_ns;
+        stats->handoffs += ctx->bus_lines[line].handoffs;
+        stats->spin_hits += ctx->bus_lines[line].sign_spin.hits;
+        stats->spin_blocks += ctx->bus_lines[line].sign_spin.blocks;
+    }
+    stats->arena_kb = ctx->arena.size / 1024;
+    stats->page_backing = ctx->arena.backing;
+    stats->K = ctx->K;
+    stats->line_count = ctx->route_count;
+    for (int line = 0; line < ctx->route_count; line++)
+        stats->lines[line] = ctx->bus_lines[line].report;
+    stats->bus_utilization = capacity_us > 0 ? (double)seat_us / capacity_us : 0.0;
+
+    // steady state lies between the first L rides and the start of the wind down
+    long long window_us = shared_memory->cool_time_us - shared_memory->warm_time_us;
+    int window_rides = shared_memory->rides_at_cool - ctx->L;
+    stats->steady_throughput = window_us > 0 && window_rides > 0 ? window_rides / (window_us / 1e6) : -1;
+
+    stats->wait_p50_us = wait_percentile(ctx, 0.5);
+    stats->wait_p99_us = wait_percentile(ctx, 0.99);
+    stats->wait_max_us = shared_memory->max_wait_us;
+    stats->wait_strategy = ctx->wait_strategy;
+
+    for (int idL = 0; idL < ctx->L; idL++) {
+        stats->spin_hits += ctx->skiers[idL].board_spin.hits + ctx->skiers[idL].alight_spin.hits;
+        stats->spin_blocks += ctx->skiers[idL].board_spin.blocks + ctx->skiers[idL].alight_spin.blocks;
+    }
+
+    stats->skier_mode = ctx->skier_mode;
+    stats->skier_workers = ctx->skier_workers;
+    stats->memory_sampled = ctx->sample_memory;
+    if (ctx->sample_memory) {
+        stats->peak_rss_kb = ctx->memory_peak.rss_kb;
+        stats->peak_pss_kb = ctx->memory_peak.pss_kb;
+        stats->base_pss_kb = ctx->memory_base.pss_kb;
+        stats->peak_kernel_kb = ctx->memory_peak.kernel_kb;
+        stats->base_kernel_kb = ctx->memory_base.kernel_kb;
+        stats->memory_per_skier_kb = memory_per_skier_kb(ctx);
+    }
+}
+
+/**
+ * @brief Hands an event to the main process through the ring of the channel. The event gets
+ * its ID under printafor, so the ring holds the events in order. A worker only waits for room,
+ * when the main process is a whole ring behind.
+ * @param ctx The context.
+ * @param type What happened.
+ * @param line The index of the line of a bus event, -1 for a skier.
+ * @param idL The ID of the skier, 0 for a bus.
+ * @param idZ The ID of the bus stop, 0 if none.
+*/
+void log_event(skibus_context *ctx, skibus_event_type type, int line, int idL, int idZ) {
+    run_channel *channel = ctx->channel;
+
+    int error;
+
+    if ((error = semaphore_wait(ctx->printafor)) < 0 || (error = semaphore_wait(&channel->free)) < 0)
+        worker_fail(ctx, "faild to log an event", error);
+
+    ctx->shared_memory->ID++;
+    channel->events[channel->tail] = (skibus_event){
+        .id = ctx->shared_memory->ID,
+        .type = type,
+        // buses are only numbered when there are more lines
+        .bus = line >= 0 && ctx->route_count > 1 ? line + 1 : 0,
+        .skier = idL,
+        .stop = idZ,
+        .model_time_us = model_elapsed_us(ctx),
+    };
+    channel->tail = (channel->tail + 1) % EVENT_RING;
+
+    if ((error = semaphore_post(&channel->ready)) < 0 || (error = semaphore_post(ctx->printafor)) < 0)
+        worker_fail(ctx, "faild to return from logging an event", error);
+}
+
+/**
+ * @brief Logs that the bus has started.
+ * @param ctx The context.
+ * @param line The index of the line.
+*/
+void bus_started(skibus_context *ctx, int line) {
+    log_event(ctx, SKIBUS_BUS_STARTED, line, 0, 0);
+}
+
+/**
+ * @brief Logs that the bus has arrived at a bus stop.
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param idZ The ID of the bus stop.
+*/
+void bus_arrived(skibus_context *ctx, int line, int idZ) {
+    log_event(ctx, SKIBUS_BUS_ARRIVED, line, 0, idZ);
+}
+
+/**
+ * @brief Logs that the bus has left a bus stop.
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @param idZ The ID of the bus stop.
+*/
+void bus_leaving(skibus_context *ctx, int line, int idZ) {
+    log_event(ctx, SKIBUS_BUS_LEAVING, line, 0, idZ);
+}
+
+/**
+ * @brief Logs that the bus has arrived at the final bus stop.
+ * @param ctx The context.
+ * @param line The index of the line.
+*/
+void bus_arrived_to_final(skibus_context *ctx, int line) {
+    log_event(ctx, SKIBUS_BUS_ARRIVED_FINAL, line, 0, ctx->routes[line].stops[ctx->routes[line].length - 1]);
+}
+
+/**
+ * @brief Logs that the bus has left the final bus stop.
+ * @param ctx The context.
+ * @param line The index of the line.
+*/
+void bus_leaving_final(skibus_context *ctx, int line) {
+    log_event(ctx, SKIBUS_BUS_LEAVING_FINAL, line, 0, ctx->routes[line].stops[ctx->routes[line].length - 1]);
+}
+
+/**
+ * @brief Logs that the bus has finished its journey.
+ * @param ctx The context.
+ * @param line The index of the line.
+*/
+void bus_finished(skibus_context *ctx, int line) {
+    log_event(ctx, SKIBUS_BUS_FINISHED, line, 0, 0);
+}
+
+/**
+ * @brief Logs that the skier has started.
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+*/
+void skier_started(skibus_context *ctx, int idL) {
+    log_event(ctx, SKIBUS_SKIER_STARTED, -1, idL, 0);
+}
+
+/**
+ * @brief Logs that the skier has arrived at a bus stop.
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ * @param idZ The ID of the bus stop.
+*/
+void skier_arrived(skibus_context *ctx, int idL, int idZ) {
+    log_event(ctx, SKIBUS_SKIER_ARRIVED, -1, idL, idZ);
+}
+
+/**
+ * @brief Logs that the skier is boarding the bus.
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ * @param idZ The ID of the bus stop, it is not part of the log line.
+*/
+void skier_boarding(skibus_context *ctx, int idL, int idZ) {
+    log_event(ctx, SKIBUS_SKIER_BOARDING, -1, idL, idZ);
+}
+
+/**
+ * @brief Logs that the skier got off to change lines.
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ * @param idZ The ID of the bus stop.
+*/
+void skier_transferring(skibus_context *ctx, int idL, int idZ) {
+    log_event(ctx, SKIBUS_SKIER_TRANSFERRING, -1, idL, idZ);
+}
+
+/**
+ * @brief Logs that the skier has reached the sky.
+ * @param ctx The context.
+ * @param idL The ID of the skier.
+ * @param idZ The ID of the stop at the lift, it is not part of the log line.
+*/
+void skier_sky(skibus_context *ctx, int idL, int idZ) {
+    log_event(ctx, SKIBUS_SKIER_SKI, -1, idL, idZ);
+}
+
+/**
+ * @brief Formats an event as a line of the classic log.
+ * @param event The event.
+ * @param buffer The buffer to fill.
+ * @param size The size of the buffer.
+ * @return The length of the line, as snprintf.
+*/
+int skibus_format_event(const skibus_event *event, char *buffer, size_t size) {
+    char bus[16] = "";
+
+    if (event->bus > 0)
+        snprintf(bus, sizeof(bus), " %d", event->bus);
+
+    switch (event->type) {
+        case SKIBUS_BUS_STARTED:
+            return snprintf(buffer, size, "%d: BUS%s: started", event->id, bus);
+        case SKIBUS_BUS_ARRIVED:
+            return snprintf(buffer, size, "%d: BUS%s: arrived to %d", event->id, bus, event->stop);
+        case SKIBUS_BUS_LEAVING:
+            return snprintf(buffer, size, "%d: BUS%s: leaving %d", event->id, bus, event->stop);
+        case SKIBUS_BUS_ARRIVED_FINAL:
+            return snprintf(buffer, size, "%d: BUS%s: arrived to final", event->id, bus);
+        case SKIBUS_BUS_LEAVING_FINAL:
+            return snprintf(buffer, size, "%d: BUS%s: leaving final", event->id, bus);
+        case SKIBUS_BUS_FINISHED:
+            return snprintf(buffer, size, "%d: BUS%s: finish", event->id, bus);
+        case SKIBUS_SKIER_STARTED:
+            return snprintf(buffer, size, "%d: L %d: started", event->id, event->skier);
+        case SKIBUS_SKIER_ARRIVED:
+            return snprintf(buffer, size, "%d: L %d: arrived to %d", event->id, event->skier, event->stop);
+        case SKIBUS_SKIER_BOARDING:
+            return snprintf(buffer, size, "%d: L %d: boarding", event->id, event->skier);
+        case SKIBUS_SKIER_TRANSFERRING:
+            return snprintf(buffer, size, "%d: L %d: transferring at %d", event->id, event->skier, event->stop);
+        case SKIBUS_SKIER_SKI:
+            return snprintf(buffer, size, "%d: L %d: going to ski", event->id, event->skier);
+    }
+    return snprintf(buffer, size, "%d: ?", event->id);
+}
+
+/**
+ * @brief Takes the oldest event from the ring, frees its entry and hands it to the event callback.
+ * Expects the ready semaphore to be taken for it.
+ * @param ctx The context.
+*/
+void deliver_event(skibus_context *ctx) {
+    run_channel *channel = ctx->channel;
+    skibus_event event = channel->events[channel->head];
+
+    channel->head = (channel->head + 1) % EVENT_RING;
+    semaphore_post(&channel->free);
+
+    if (ctx->callbacks.event != NULL)
+        ctx->callbacks.event(&event, ctx->callbacks.user);
+}
+
+/**
+ * @brief Hands the waiting events to the event callback.
+ * @param ctx The context.
+*/
+void drain_events(skibus_context *ctx) {
+    while (semaphore_trywait(&ctx->channel->ready))
+        deliver_event(ctx);
+}
+
+/**
+ * @brief Waits for an event for a while, then hands all waiting events to the event callback.
+ * @param ctx The context.
+ * @param timeout_us The longest wait in real microseconds.
+*/
+void wait_for_events(skibus_context *ctx, long timeout_us) {
+    if (semaphore_timedwait(&ctx->channel->ready, timeout_us) == 0) {
+        deliver_event(ctx);
+        drain_events(ctx);
+    }
+}
+
+/**
+ * @brief Returns a random number from a random stream. It is the generator of rand_r of glibc,
+ * written out, so the seeded runs stay the same and a cloned skier calls no C library for it.
+ * @param rng The random stream of the caller.
+*/
+int random_number(unsigned int *rng) {
+    unsigned int next = *rng;
+    int result;
+
+    next = next * 1103515245 + 12345;
+    result = (next / 65536) % 2048;
+    next = next * 1103515245 + 12345;
+    result = (result << 10) ^ (next / 65536) % 1024;
+    next = next * 1103515245 + 12345;
+    result = (result << 10) ^ (next / 65536) % 1024;
+
+    *rng = next;
+    return result;
+}
+
+/**
+ * @brief Returns a random number in the interval <0, 1).
+ * @param rng The random stream of the caller.
+*/
+double random_unit(unsigned int *rng) {
+    return random_number(rng) / (RAND_MAX + 1.0);
+}
+
+/**
+ * @brief Orders the arrivals by time, ties by the skier.
+*/
+int compare_arrivals(const void *a, const void *b) {
+    const arrival *x = a, *y = b;
+    if (x->time_us != y->time_us)
+        return x->time_us < y->time_us ? -1 : 1;
+    return x->idL - y->idL;
+}
+
+/**
+ * @brief Generates the first arrival of every skier up front, all of them within TL.
+ * @param ctx The context.
+*/
+void generate_arrivals(skibus_context *ctx) {
+    long L = ctx->L, TL = ctx->TL;
+    unsigned int *rng = &ctx->main_rng;
+    double poisson_time = 0;
+    long long burst_time = 0;
+    int burst_stop = 0, burst_left = 0;
+
+    for (int idL = 0; idL < L; idL++) {
+        long long arrival_time;
+        int stop = ctx->route_origins[random_number(rng) % ctx->route_origin_count];
+
+        switch (ctx->arrival_profile) {
+            case SKIBUS_ARRIVALS_POISSON:
+                // exponential gaps with a rate of L skiers per TL
+                poisson_time += -log(1.0 - random_unit(rng)) * TL / (L > 0 ? L : 1);
+                arrival_time = poisson_time;
+                break;
+            case SKIBUS_ARRIVALS_PEAK:
+                // triangular curve, most skiers come in the middle of the morning
+                arrival_time = (random_unit(rng) + random_unit(rng)) / 2 * TL;
+                break;
+            case SKIBUS_ARRIVALS_BURSTY:
+                // groups of up to a busload arrive together at the same stop
+                if (burst_left == 0) {
+                    burst_left = 1 + random_number(rng) % ctx->K;
+                    burst_time = random_unit(rng) * TL;
+                    burst_stop = stop;
+                }
+                burst_left--;
+                stop = burst_stop;
+                arrival_time = burst_time + random_unit(rng) * TL / 100;
+                break;
+            default:
+                arrival_time = random_unit(rng) * (TL + 1);
+                break;
+        }
+
+        ctx->arrival_schedule[idL] = (arrival){ arrival_time, idL };
+        ctx->skier_arrivals[idL].stop = stop;
+        ctx->skier_arrivals[idL].released = false;
+    }
+
+    qsort(ctx->arrival_schedule, L, sizeof(arrival), compare_arrivals);
+}
+
+/**
+ * @brief Maps and fills in the arrival schedule.
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+*/
+int init_arrivals(skibus_context *ctx) {
+    for (int idL = 0; idL < ctx->L; idL++)
+        semaphore_init(&ctx->skier_arrivals[idL].sign, 0);
+
+    // a restored schedule is copied over it
+    generate_arrivals(ctx);
+    return 0;
+}
+
+/**
+ * @brief Destroys the arrival schedule, whatever part of it exists.
+ * @param ctx The context.
+*/
+void destroy_arrivals(skibus_context *ctx) {
+    ctx->arrival_schedule = NULL;
+    ctx->skier_arrivals = NULL;
+}
+
+/**
+ * @brief Creates the injector process, that lets the skiers arrive at the times from the schedule.
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+*/
+int craete_injector_process(skibus_context *ctx) {
+
+    __atomic_add_fetch(&ctx->channel->workers_running, 1, __ATOMIC_RELAXED);
+    pid_t id = fork();
+
+    if (id < 0) {
+        __atomic_sub_fetch(&ctx->channel->workers_running, 1, __ATOMIC_RELAXED);
+        return set_error(ctx, "failed to create the injector process");
+    } else if (id == 0) {
+
+        for (int i = ctx->shared_memory->next_arrival; i < ctx->L; i++) {
+            arrival *next = &ctx->arrival_schedule[i];
+            // real time, at which the arrival is due
+            long long due_us = next->time_us / ctx->time_scale;
+            long long wait_us = due_us - real_elapsed_us(ctx);
+
+            if (wait_us >= SLEEP_FLOOR_US)
+                sleep_us(wait_us);
+
+            wait_for_my_turn(ctx);
+            ctx->skier_arrivals[next->idL].released = true;
+            ctx->shared_memory->next_arrival = i + 1;
+            done_with_my_turn(ctx);
+
+            int error = semaphore_post(&ctx->skier_arrivals[next->idL].sign);
+            if (error < 0)
+                worker_fail(ctx, "injector faild to let a skier arrive", error);
+        }
+
+        worker_exit(ctx);
+    }
+
+    add_worker(ctx, id, true);
+    return 0;
+}
+
+/**
+ * @brief Picks the stop and a random reachable lift for the next lap of a skier.
+ * @param ctx The context.
+ * @param idL The index of the skier.
+*/
+void skier_plan_lap(skibus_context *ctx, int idL) {
+    skier_state *skier = &ctx->skiers[idL];
+    bool scheduled = skier->lap == 0 && ctx->arrival_profile != SKIBUS_ARRIVALS_NONE;
+
+    // select a ranodm destion the skier has to go to
+    skier->origin = scheduled ? ctx->skier_arrivals[idL].stop : ctx->route_origins[random_number(&skier->rng) % ctx->route_origin_count];
+
+    // select a random lift, that is reachable from the stop
+    route_leg candidate[MAX_LINES];
+    int reachable = 0;
+    skier->leg = skier->leg_count = 0;
+    for (int i = 0; i < ctx->route_lift_count; i++) {
+        int count = find_route(ctx, skier->origin, ctx->route_lifts[i], candidate);
+        if (count > 0 && random_number(&skier->rng) % ++reachable == 0) {
+            memcpy(skier->legs, candidate, sizeof(route_leg) * count);
+            skier->leg_count = count;
+        }
+    }
+}
+
+/**
+ * @brief Takes a skier one phase further. Every change of the skier state happens together
+ * with its log event and the counters, under the lock of the line or the shared data,
+ * so a checkpoint never sees a half done step.
+ * @param ctx The context.
+ * @param idL The index of the skier.
+*/
+void skier_step(skibus_context *ctx, int idL) {
+    shared_data *shared_memory = ctx->shared_memory;
+    skier_state *skier = &ctx->skiers[idL];
+    // planning the next lap overwrites the legs, keep the current one
+    route_leg leg = skier->legs[skier->leg];
+    int line = leg.line;
+    line_stop *board = &ctx->bus_lines[line].stops[leg.board];
+    line_stop *alight = &ctx->bus_lines[line].stops[leg.alight];
+    int error;
+
+    switch (skier->phase) {
+        case SKIER_STARTING:
+            wait_for_my_turn(ctx);
+            skier_started(ctx, idL+1);
+            skier_plan_lap(ctx, idL);
+            skier->phase = SKIER_WALKING;
+            done_with_my_turn(ctx);
+            break;
+
+        case SKIER_WALKING:
+            // wait for the skier to reach the destination, or for the injector to let it arrive
+            if (skier->lap == 0 && ctx->arrival_profile != SKIBUS_ARRIVALS_NONE) {
+                if ((error = semaphore_wait(&ctx->skier_arrivals[idL].sign)) < 0)
+                    worker_fail(ctx, "skier faild to wait for its arrival", error);
+            } else {
+                random_sleep(ctx, ctx->TL, &skier->rng);
+            }
+
+            // take a ticket at the bus stop
+            lock_line(ctx, line);
+            skier_arrived(ctx, idL+1, skier->origin);
+            skier->ticket = __atomic_fetch_add(&shared_memory->next_ticket, 1, __ATOMIC_RELAXED);
+            skier->queued_us = model_elapsed_us(ctx);
+            queue_skier(ctx, line, leg.board, idL);
+            skier->phase = SKIER_WAITING;
+            unlock_line(ctx, line);
+            break;
+
+        case SKIER_TRANSFERRING:
+            lock_line(ctx, line);
+            skier->ticket = __atomic_fetch_add(&shared_memory->next_ticket, 1, __ATOMIC_RELAXED);
+            skier->queued_us = model_elapsed_us(ctx);
+            queue_skier(ctx, line, leg.board, idL);
+            skier->phase = SKIER_WAITING;
+            unlock_line(ctx, line);
+            break;
+
+        case SKIER_WAITING:
+            // skier needs to wait for the bus stop to become available
+            // the bus wakes the skiers up one by one, in the order of their tickets
+            if ((error = handshake_wait(ctx, &ctx->skier_wakes[idL], &skier->board_spin)) < 0)
+                worker_fail(ctx, "skier faild to shop up to the bus stop", error);
+
+            // board the bus
+            lock_line(ctx, line);
+            skier_boarding(ctx, idL+1, ctx->routes[line].stops[leg.board]);
+            record_wait(ctx, idL);
+
+            if (skier->leg == 0) {
+                wait_for_my_turn(ctx);
+                shared_memory->skiers_boarded++;
+                done_with_my_turn(ctx);
+            }
+
+            ctx->bus_lines[line].occupancy++;
+            board->waiting--;
+            alight->alighting++;
+            skier->phase = SKIER_RIDING;
+            done_at_stop(ctx, line);
+            break;
+
+        case SKIER_RIDING:
+            // wait for the stop to get off at
+            if ((error = handshake_wait(ctx, &alight->alight, &skier->alight_spin)) < 0)
+                worker_fail(ctx, "skier fiald to get of the bus at the final stop", error);
+
+            // leave the bus
+            lock_line(ctx, line);
+            ctx->bus_lines[line].occupancy--;
+            alight->alighting--;
+
+            if (skier->leg < skier->leg_count - 1) {
+                skier_transferring(ctx, idL+1, ctx->routes[line].stops[leg.alight]);
+                skier->leg++;
+                skier->phase = SKIER_TRANSFERRING;
+                done_at_stop(ctx, line);
+                break;
+            }
+
+            wait_for_my_turn(ctx);
+            skier_sky(ctx, idL+1, ctx->routes[line].stops[leg.alight]);
+
+            // the first L rides are the cold start of the day
+            shared_memory->skiers_finished++;
+            if (shared_memory->skiers_finished == ctx->L)
+                shared_memory->warm_time_us = model_elapsed_us(ctx);
+            // on average, the skiers are starting their last lap
+            if (ctx->duration == 0 && shared_memory->skiers_finished == ctx->L * (ctx->laps - 1)) {
+                shared_memory->cool_time_us = model_elapsed_us(ctx);
+                shared_memory->rides_at_cool = shared_memory->skiers_finished;
+            }
+
+            // the skier keeps going back to the bus until the day is over
+            skier->lap++;
+            if (ctx->duration > 0 ? model_elapsed_us(ctx) < ctx->duration : skier->lap < ctx->laps) {
+                skier_plan_lap(ctx, idL);
+                skier->phase = SKIER_WALKING;
+            } else {
+                skier->phase = SKIER_DONE;
+                // with a duration, the day winds down with the first skier going home
+                if (shared_memory->skiers_done++ == 0 && ctx->duration > 0) {
+                    shared_memory->cool_time_us = model_elapsed_us(ctx);
+                    shared_memory->rides_at_cool = shared_memory->skiers_finished;
+                }
+            }
+            done_with_my_turn(ctx);
+            done_at_stop(ctx, line);
+            break;
+
+        case SKIER_DONE:
+            break;
+    }
+}
+
+/**
+ * @brief Runs a skier until it is done for the day, the body of a skier process or clone.
+ * @param arg The skier_worker_arg of the skier.
+*/
+int skier_worker(void *arg) {
+    skier_worker_arg *worker = arg;
+
+    while (worker->ctx->skiers[worker->idL].phase != SKIER_DONE)
+        skier_step(worker->ctx, worker->idL);
+
+    worker_exit(worker->ctx);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Creates the skier processes, skiers that are done for the day are skipped. Cloned
+ * skiers share the address space of the caller and run on a small stack of their own,
+ * they cost a kernel task and the few stack pages they touch.
+ * @param ctx The context.
+ * @return 0 on success, -1 on failure.
+*/
+int create_skiers_processes(skibus_context *ctx) {
+
+    pid_t id;
+    size_t page = sysconf(_SC_PAGESIZE), slot = page + SKIER_STACK_SIZE;
+
+    if (ctx->skier_mode == SKIBUS_SKIERS_CLONE && ctx->L > 0) {
+        ctx->skier_stacks_size = slot * ctx->L;
+        ctx->skier_stacks = mmap(NULL, ctx->skier_stacks_size, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_STACK, -1, 0);
+
+        if (ctx->skier_stacks == MAP_FAILED) {
+            ctx->skier_stacks = NULL;
+            return set_error(ctx, "mapping of skier stacks failed");
+        }
+    }
+
+    for (int idL = 0; idL < ctx->L; idL++) {
+
+        if (ctx->skiers[idL].phase == SKIER_DONE)
+            continue;
+
+        ctx->skier_args[idL] = (skier_worker_arg){ ctx, idL };
+        __atomic_add_fetch(&ctx->channel->workers_running, 1, __ATOMIC_RELAXED);
+
+        if (ctx->skier_mode == SKIBUS_SKIERS_CLONE) {
+            // an overflow hits the guard page instead of the stack of the neighbour
+            char *stack = ctx->skier_stacks + slot * idL;
+            if (mprotect(stack, page, PROT_NONE) < 0)
+                id = -1;
+            else
+                id = clone(skier_worker, stack + slot, CLONE_VM | SIGCHLD, &ctx->skier_args[idL]);
+        } else {
+            id = fork();
+        }
+
+        if (id < 0) {
+            __atomic_sub_fetch(&ctx->channel->workers_running, 1, __ATOMIC_RELAXED);
+            return set_error(ctx, "failed to create a skiier");
+        } else if (id == 0) {
+            skier_worker(&ctx->skier_args[idL]);
+        }
+
+        ctx->skier_workers++;
+        add_worker(ctx, id, ctx->skier_mode == SKIBUS_SKIERS_PROCESS);
+    }
+    return 0;
+}
+
+/**
+ * @brief Unmaps the stacks of the cloned skiers, once all of them have exited.
+ * @param ctx The context.
+*/
+void destroy_skier_stacks(skibus_context *ctx) {
+    if (ctx->skier_stacks != NULL)
+        munmap(ctx->skier_stacks, ctx->skier_stacks_size);
+    ctx->skier_stacks = NULL;
+}
+
+/**
+ * @brief Adds the resident and proportional set of a process to a sample.
+ * @param pid The process, 0 for the calling one.
+ * @param usage The sample to add to.
+ * @return 0 on success, -1 if the process is gone.
+*/
+int read_process_memory(pid_t pid, memory_usage *usage) {
+    char path[64], line[128];
+    long long value;
+
+    if (pid == 0)
+        snprintf(path, sizeof(path), "/proc/self/smaps_rollup");
+    else
+        snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pid);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "Rss: %lld", &value) == 1)
+            usage->rss_kb += value;
+        else if (sscanf(line, "Pss: %lld", &value) == 1)
+            usage->pss_kb += value;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Samples the memory of the main process, the cloned skiers included, of the workers
+ * with an address space of their own and the kernel stacks and page tables of the system.
+ * @param ctx The context.
+ * @param usage The sample to fill.
+*/
+void sample_memory(skibus_context *ctx, memory_usage *usage) {
+    char line[128];
+    long long value;
+
+    usage->rss_kb = usage->pss_kb = usage->kernel_kb = 0;
+
+    read_process_memory(0, usage);
+    for (int i = 0; i < ctx->memory_count; i++)
+        read_process_memory(ctx->memory_pids[i], usage);
+
+    // the tasks and page tables are not part of any process
+    FILE *file = fopen("/proc/meminfo", "r");
+    if (file == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "KernelStack: %lld", &value) == 1 || sscanf(line, "PageTables: %lld", &value) == 1)
+            usage->kernel_kb += value;
+    }
+    fclose(file);
+}
+
+/**
+ * @brief Samples the memory and raises the peaks.
+ * @param ctx The context.
+*/
+void track_memory_peak(skibus_context *ctx) {
+    memory_usage now;
+
+    sample_memory(ctx, &now);
+    if (now.rss_kb > ctx->memory_peak.rss_kb)
+        ctx->memory_peak.rss_kb = now.rss_kb;
+    if (now.pss_kb > ctx->memory_peak.pss_kb)
+        ctx->memory_peak.pss_kb = now.pss_kb;
+    if (now.kernel_kb > ctx->memory_peak.kernel_kb)
+        ctx->memory_peak.kernel_kb = now.kernel_kb;
+}
+
+/**
+ * @brief Returns the memory every skier has added at the peak, the proportional set and
+ * the kernel memory over the state before the skiers were created.
+ * @param ctx The context.
+*/
+double memory_per_skier_kb(skibus_context *ctx) {
+    if (ctx->skier_workers == 0)
+        return 0;
+
+    long long added = ctx->memory_peak.pss_kb + ctx->memory_peak.kernel_kb - ctx->memory_base.pss_kb - ctx->memory_base.kernel_kb;
+    return added > 0 ? (double)added / ctx->skier_workers : 0;
+}
+
+/**
+ * @brief Creates the ski bus process of a line, the bus carries on from its position in the shared state.
+ * @param ctx The context.
+ * @param line The index of the line.
+ * @return 0 on success, -1 on failure.
+*/
+int craete_ski_bus_process(skibus_context *ctx, int line) {
+
+    __atomic_add_fetch(&ctx->channel->workers_running, 1, __ATOMIC_RELAXED);
+    pid_t id = fork();
+
+    if (id < 0) {
+        __atomic_sub_fetch(&ctx->channel->workers_running, 1, __ATOMIC_RELAXED);
+        return set_error(ctx, "failed to create ski bus process");
+    } else if (id == 0) {
+
+        bus_line *bus = &ctx->bus_lines[line];
+        route_line *route = &ctx->routes[line];
+        int amount_of_skiers_to_board, amount_of_skiers_to_leave, available_space, left_behind;
+        int boarding[MAX_CAPACITY];
+
+        lock_line(ctx, line);
+        if (!bus->started) {
+            bus_started(ctx, line);
+            bus->started = true;
+            bus->trip_start_us = model_elapsed_us(ctx);
+        }
+        unlock_line(ctx, line);
+
+        while (1) {
+            int idZ = bus->position;
+            bool final = idZ == route->length - 1;
+
+            if (!bus->at_stop) {
+                lock_line(ctx, line);
+                int riding = bus->occupancy;
+                unlock_line(ctx, line);
+
+                // travel to bus stop
+                long hop = random_hop(ctx, &bus->hops[idZ], &bus->rng);
+
+                lock_line(ctx, line);
+                bus->travel_us += hop;
+                bus->seat_us += riding * hop;
+
+                if (final)
+                    bus_arrived_to_final(ctx, line);
+                else
+                    bus_arrived(ctx, line, route->stops[idZ]);
+                bus->at_stop = true;
+                bus->arrived_us = model_elapsed_us(ctx);
+                unlock_line(ctx, line);
+            }
+
+            // let the skiers, that get off here, leave first
+            lock_line(ctx, line);
+            amount_of_skiers_to_leave = bus->stops[idZ].alighting;
+            unlock_line(ctx, line);
+
+            release_and_wait(ctx, line, &bus->stops[idZ].alight, NULL, amount_of_skiers_to_leave);
+
+            amount_of_skiers_to_board = left_behind = 0;
+            if (!final) {
+                lock_line(ctx, line);
+                // Calculate the available space on the bus
+                available_space = bus->capacity - bus->occupancy;
+
+                // amount of peopole that will board the bus
+                amount_of_skiers_to_board = bus->stops[idZ].waiting >= available_space ? available_space : bus->stops[idZ].waiting;
+                left_behind = bus->stops[idZ].waiting - amount_of_skiers_to_board;
+
+                // the oldest tickets get on
+                dequeue_skiers(ctx, line, idZ, boarding, amount_of_skiers_to_board);
+                unlock_line(ctx, line);
+
+                release_and_wait(ctx, line, NULL, boarding, amount_of_skiers_to_board);
+            }
+
+            lock_line(ctx, line);
+            record_departure(ctx, line, idZ, amount_of_skiers_to_leave, amount_of_skiers_to_board, left_behind);
+            if (final)
+                bus_leaving_final(ctx, line);
+            else
+                bus_leaving(ctx, line, route->stops[idZ]);
+            bus->at_stop = false;
+            bus->position = final ? 0 : idZ + 1;
+            unlock_line(ctx, line);
+
+            if (!final)
+                continue;
+
+            // if all the skiers are done for the day, exit
+            lock_line(ctx, line);
+            wait_for_my_turn(ctx);
+            bool all_done = ctx->shared_memory->skiers_done == ctx->L;
+            if (all_done) {
+                bus_finished(ctx, line);
+                bus->finished = true;
+            }
+            done_with_my_turn(ctx);
+            unlock_line(ctx, line);
+
+            if (all_done) {
+                worker_exit(ctx);
+            }
+        }
+    }
+
+    add_worker(ctx, id, true);
+    return 0;
+}
+
+/**
+ * @brief Takes note of a new worker, to wait for it and to sample its memory.
+ * @param ctx The context.
+ * @param id The process of the worker.
+ * @param own_memory The worker has an address space of its own.
+*/
+void add_worker(skibus_context *ctx, pid_t id, bool own_memory) {
+    ctx->worker_pids[ctx->worker_count++] = id;
+    if (own_memory)
+        ctx->memory_pids[ctx->memory_count++] = id;
+}
+
+/**
+ * @brief Waits for the workers, that have exited. Only the workers of this run are waited
+ * for, so other children of the caller are left alone.
+ * @param ctx The context.
+ * @param block Wait until all of them have exited.
+ * @return 0 if all exited fine, -1 if one has failed.
+*/
+int reap_workers(skibus_context *ctx, bool block) {
+    int result = 0;
+
+    for (int i = 0; i < ctx->worker_count; ) {
+        int status;
+        pid_t pid = waitpid(ctx->worker_pids[i], &status, block ? 0 : WNOHANG);
+
+        if (pid == 0) {
+            i++;
+            continue;
+        }
+        if (pid < 0 && errno == EINTR)
+            continue;
+
+        // a worker, that is gone without a status, has been waited for by the caller
+        if (pid > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS))
+            result = -1;
+        ctx->worker_pids[i] = ctx->worker_pids[--ctx->worker_count];
+    }
+
+    if (result < 0 && ctx->channel->failed)
+        snprintf(ctx->error, sizeof(ctx->error), "%.64s: %s", ctx->channel->error, strerror(ctx->channel->error_number));
+    else if (result < 0)
+        set_error(ctx, "a worker has exited abnormally");
+    return result;
+}
+
+/**
+ * @brief Kills and waits for all the workers, that are left.
+ * @param ctx The context.
+*/
+void kill_workers(skibus_context *ctx) {
+    for (int i = 0; i < ctx->worker_count; i++)
+        kill(ctx->worker_pids[i], SIGKILL);
+
+    // keep the reason of the failure, that got us here
+    char error[MAX_ERROR_LENGTH];
+    memcpy(error, ctx->error, sizeof(error));
+    reap_workers(ctx, true);
+    memcpy(ctx->error, error, sizeof(error));
+}
+
+/**
+ * @brief Takes a semaphore in the main process. A worker may hold it while it waits for room
+ * in the event ring, so the events are handed out in the meantime.
+ * @param ctx The context.
+ * @param sem The semaphore.
+ * @return 0 on success, -1 if a worker has failed.
+*/
+int lock_draining(skibus_context *ctx, semaphore *sem) {
+    while (!semaphore_trywait(sem)) {
+        wait_for_events(ctx, EVENT_WAIT_US);
+        // a worker, that died holding the semaphore, never gives it back
+        if (reap_workers(ctx, false) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Hands out the events, takes the checkpoints and samples the memory, until the workers
+ * are done. The workers are checked for less often, when there are many of them, same as the
+ * memory is sampled less often, when a sample is slow.
+ * @param ctx The context.
+ * @return 0 on success, -1 if a worker has failed.
+*/
+int supervise(skibus_context *ctx) {
+    long long next_reap_us = 0, next_sample_us = 0;
+    long long interval_us = ctx->checkpoint_interval * 1e6;
+    long long next_checkpoint_us = model_elapsed_us(ctx) + interval_us;
+
+    while (1) {
+        wait_for_events(ctx, EVENT_WAIT_US);
+
+        if (ctx->checkpoint_file_name != NULL) {
+            bool due = interval_us > 0 && model_elapsed_us(ctx) >= next_checkpoint_us;
+            if (ctx->checkpoint_requested || due) {
+                ctx->checkpoint_requested = 0;
+                if (due)
+                    next_checkpoint_us = model_elapsed_us(ctx) + interval_us;
+                // a file, that could not be written, leaves the previous checkpoint in place,
+                // a worker, that has died, ends the run, the rest would wait for it forever
+                if (write_checkpoint(ctx, ctx->checkpoint_file_name) == -2) {
+                    kill_workers(ctx);
+                    drain_events(ctx);
+                    return -1;
+                }
+            }
+        }
+
+        // the last worker to finish lets us know
+        if (__atomic_load_n(&ctx->channel->workers_running, __ATOMIC_ACQUIRE) == 0) {
+            int result = reap_workers(ctx, true);
+            drain_events(ctx);
+            return result;
+        }
+
+        long long now_us = real_elapsed_us(ctx);
+        if (now_us >= next_reap_us) {
+            if (reap_workers(ctx, false) < 0) {
+                kill_workers(ctx);
+                drain_events(ctx);
+                return -1;
+            }
+            long long took_us = real_elapsed_us(ctx) - now_us;
+            next_reap_us = now_us + (took_us * 10 > REAP_US ? took_us * 10 : REAP_US);
+        }
+
+        if (ctx->sample_memory && now_us >= next_sample_us) {
+            track_memory_peak(ctx);
+            // sampling thousands of processes is slow, keep it under a tenth of the run
+            long long took_us = real_elapsed_us(ctx) - now_us;
+            next_sample_us = now_us + (took_us * 10 > MEMORY_SAMPLE_US ? took_us * 10 : MEMORY_SAMPLE_US);
+        }
+    }
+}
+
+/**
+ * @brief Writes the complete simulation state to a checkpoint file. The file is laid out as
+ * the header followed by the shared memory regions, so it can be mapped back as it is.
+ * All locks are taken in the order lines, shared data, print, which is the order the
+ * processes nest them in, so the state is consistent. Every event up to the checkpoint
+ * has been handed out before the file is written.
+ * @param ctx The context.
+ * @param file_name The checkpoint file.
+ * @return 0 on success, -1 if the file could not be written, -2 if a worker has died or failed
+ * while the locks were taken.
+*/
+int write_checkpoint(skibus_context *ctx, const char *file_name) {
+    long L = ctx->L;
+    semaphore *locks[MAX_LINES + 2];
+    int lock_count = 0, locked = 0;
+    char temp_name[256];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", file_name);
+
+    FILE *file = fopen(temp_name, "wb");
+    if (file == NULL)
+        return -1;
+
+    for (int line = 0; line < ctx->route_count; line++)
+        locks[lock_count++] = &ctx->bus_lines[line].lock;
+    locks[lock_count++] = ctx->datafor;
+    locks[lock_count++] = ctx->printafor;
+
+    while (locked < lock_count && lock_draining(ctx, locks[locked]) == 0)
+        locked++;
+
+    // lock_draining only gives up, when a worker has died or failed
+    bool died = locked < lock_count;
+    bool ok = !died;
+    if (ok) {
+        // the receiver has every event before the checkpoint
+        drain_events(ctx);
+        if (ctx->callbacks.checkpoint != NULL)
+            ctx->callbacks.checkpoint(ctx->callbacks.user);
+
+        checkpoint_header header = {
+            .magic = CHECKPOINT_MAGIC,
+            .L = L, .Z = ctx->Z, .K = ctx->K, .TL = ctx->TL, .TB = ctx->TB,
+            .time_scale = ctx->time_scale,
+            .laps = ctx->laps,
+            .duration = ctx->duration,
+            .arrival_profile = ctx->arrival_profile,
+            .route_count = ctx->route_count,
+            .model_time_us = model_elapsed_us(ctx),
+        };
+        memcpy(header.routes, ctx->routes, sizeof(ctx->routes));
+
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(ctx->shared_memory, sizeof(shared_data), 1, file) == 1 &&
+            fwrite(ctx->bus_lines, sizeof(bus_line), ctx->route_count, file) == (size_t)ctx->route_count &&
+            fwrite(ctx->skiers, sizeof(skier_state), L, file) == (size_t)L;
+
+        if (ok && ctx->arrival_profile != SKIBUS_ARRIVALS_NONE) {
+            ok = fwrite(ctx->arrival_schedule, sizeof(arrival), L, file) == (size_t)L &&
+                fwrite(ctx->skier_arrivals, sizeof(skier_arrival), L, file) == (size_t)L;
+        }
+    }
+
+    while (locked > 0)
+        semaphore_post(locks[--locked]);
+
+    // replace the previous checkpoint only once the new one is complete
+    if (fclose(file) != 0 || !ok || rename(temp_name, file_name) < 0) {
+        unlink(temp_name);
+        return died ? -2 : -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks the arguments of a run, they come from the configuration or from a checkpoint.
+ * @param ctx The context, with the arguments in place.
+ * @return 0 on success, -1 if one is out of range.
+*/
+int check_arguments(skibus_context *ctx) {
+    if (!(ctx->time_scale >= 1))
+        return set_error(ctx, "Invalid value for the time scale");
+    if (ctx->L < 0 || ctx->L >= SKIBUS_MAX_SKIERS)
+        return set_error(ctx, "Invalid value for L");
+    if (ctx->Z <= 0 || ctx->Z > 10)
+        return set_error(ctx, "Invalid value for Z");
+    if (ctx->K < 10 || ctx->K > MAX_CAPACITY)
+        return set_error(ctx, "Invalid value for K");
+    // the limits hold in real time, model time may stretch them by the time scale
+    if (ctx->TL < 0 || ctx->TL > MAX_TL * ctx->time_scale)
+        return set_error(ctx, "Invalid value for TL");
+    if (ctx->TB < 0 || ctx->TB > MAX_TB * ctx->time_scale)
+        return set_error(ctx, "Invalid value for TB");
+    if (ctx->laps < 1 || ctx->duration < 0)
+        return set_error(ctx, "Invalid length of the day");
+    if (ctx->arrival_profile < SKIBUS_ARRIVALS_NONE || ctx->arrival_profile > SKIBUS_ARRIVALS_BURSTY)
+        return set_error(ctx, "Invalid arrival profile");
+    return 0;
+}
+
+/**
+ * @brief Checks the route network of a checkpoint, every line has to fit a bus line and every
+ * stop has to be an ID. A default line may be a single stop.
+ * @param ctx The context, with the route network in place.
+ * @return 0 on success, -1 if it is out of range.
+*/
+int check_routes(skibus_context *ctx) {
+    if (ctx->route_count < 1 || ctx->route_count > MAX_LINES)
+        return set_error(ctx, "Invalid route network");
+    for (int line = 0; line < ctx->route_count; line++) {
+        if (ctx->routes[line].length < 1 || ctx->routes[line].length > MAX_LINE_STOPS)
+            return set_error(ctx, "Invalid route network");
+        for (int i = 0; i < ctx->routes[line].length; i++) {
+            if (ctx->routes[line].stops[i] < 1 || ctx->routes[line].stops[i] > MAX_STOPS)
+                return set_error(ctx, "Invalid route network");
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks the state of a checkpoint, that the header leaves to the file: the bus lines,
+ * the skiers and the arrivals. Everything, that is used as an index, has to be in range.
+ * Expects the arguments and the route network of the context to be checked already.
+ * @param ctx The context, with the configuration of the checkpoint.
+ * @param header The mapped checkpoint, its size matches the configuration.
+ * @return 0 on success, -1 if the state is out of range.
+*/
+int check_checkpoint_state(skibus_context *ctx, const checkpoint_header *header) {
+    const shared_data *shared_memory = (const shared_data *)(header + 1);
+    const bus_line *lines = (const bus_line *)(shared_memory + 1);
+    const skier_state *skiers = (const skier_state *)(lines + ctx->route_count);
+
+    for (int line = 0; line < ctx->route_count; line++) {
+        const bus_line *bus = &lines[line];
+        if (bus->capacity < 1 || bus->capacity > MAX_CAPACITY || bus->position < 0 ||
+            bus->position >= ctx->routes[line].length)
+            return set_error(ctx, "Invalid bus line");
+
+        for (int i = 0; i < ctx->routes[line].length; i++) {
+            const hop_time *hop = &bus->hops[i];
+            if ((hop->kind != SKIBUS_TRAVEL_UNIFORM && hop->kind != SKIBUS_TRAVEL_EXPONENTIAL) ||
+                hop->min_us < 0 || hop->max_us < hop->min_us || hop->mean_us < 0)
+                return set_error(ctx, "Invalid travel time");
+        }
+    }
+
+    // every leg is checked, the ones of past laps too, since the current one is read from it
+    for (long idL = 0; idL < ctx->L; idL++) {
+        const skier_state *skier = &skiers[idL];
+        if (skier->phase < SKIER_STARTING || skier->phase > SKIER_DONE || skier->leg < 0 ||
+            skier->leg >= MAX_LINES || skier->leg_count < 0 || skier->leg_count > MAX_LINES)
+            return set_error(ctx, "Invalid skier");
+
+        for (int i = 0; i < MAX_LINES; i++) {
+            const route_leg *leg = &skier->legs[i];
+            if (leg->line < 0 || leg->line >= ctx->route_count || leg->board < 0 || leg->alight < 0 ||
+                leg->board >= ctx->routes[leg->line].length || leg->alight >= ctx->routes[leg->line].length)
+                return set_error(ctx, "Invalid skier");
+        }
+    }
+
+    if (ctx->arrival_profile == SKIBUS_ARRIVALS_NONE)
+        return 0;
+
+    const arrival *schedule = (const arrival *)(skiers + ctx->L);
+    const skier_arrival *arrivals = (const skier_arrival *)(schedule + ctx->L);
+    if (shared_memory->next_arrival < 0 || shared_memory->next_arrival > ctx->L)
+        return set_error(ctx, "Invalid arrival schedule");
+    for (long i = 0; i < ctx->L; i++) {
+        if (schedule[i].idL < 0 || schedule[i].idL >= ctx->L || arrivals[i].stop < 1 || arrivals[i].stop > MAX_STOPS)
+            return set_error(ctx, "Invalid arrival schedule");
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads the configuration from the header of a checkpoint file and maps the file.
+ * @param ctx The context.
+ * @param file_name The checkpoint file.
+ * @param size Filled with the size of the mapping.
+ * @return The mapped file, NULL if it is not a valid checkpoint.
+*/
+checkpoint_header* load_checkpoint(skibus_context *ctx, const char *file_name, size_t *size) {
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    checkpoint_header *header = *size >= sizeof(checkpoint_header) ?
+        mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fileno(file), 0) : MAP_FAILED;
+    fclose(file);
+
+    if (header == MAP_FAILED)
+        return NULL;
+
+    size_t expected = sizeof(checkpoint_header) + sizeof(shared_data) +
+        sizeof(bus_line) * header->route_count + sizeof(skier_state) * header->L;
+    if (header->arrival_profile != SKIBUS_ARRIVALS_NONE)
+        expected += (sizeof(arrival) + sizeof(skier_arrival)) * header->L;
+
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 || *size != expected) {
+        munmap(header, *size);
+        return NULL;
+    }
+
+    ctx->L = header->L;
+    ctx->Z = header->Z;
+    ctx->K = header->K;
+    ctx->TL = header->TL;
+    ctx->TB = header->TB;
+    ctx->time_scale = header->time_scale;
+    ctx->laps = header->laps;
+    ctx->duration = header->duration;
+    ctx->arrival_profile = header->arrival_profile;
+    ctx->route_count = header->route_count;
+    memcpy(ctx->routes, header->routes, sizeof(ctx->routes));
+
+    // a damaged or foreign checkpoint of the right size gets the same checks as a fresh configuration
+    if (check_arguments(ctx) < 0 || check_routes(ctx) < 0 || check_checkpoint_state(ctx, header) < 0) {
+        munmap(header, *size);
+        return NULL;
+    }
+    return header;
+}
+
+/**
+ * @brief Orders skier indices by their tickets.
+*/
+int compare_tickets(const void *a, const void *b, void *skiers) {
+    skier_state *states = skiers;
+    long long x = states[*(const int *)a].ticket, y = states[*(const int *)b].ticket;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Copies the state from a mapped checkpoint into the freshly initialized shared memory.
+ * The semaphores start over, so the counters that mirror the skiers blocked on them are
+ * rebuilt from the skier states and every handoff in progress is done again.
+ * @param ctx The context.
+ * @param header The mapped checkpoint.
+ * @return 0 on success, -1 on failure.
+*/
+int restore_checkpoint(skibus_context *ctx, checkpoint_header *header) {
+    long L = ctx->L;
+    char *data = (char *)(header + 1);
+
+    // keep the clock of this run
+    struct timespec start_time = ctx->shared_memory->start_time;
+    memcpy(ctx->shared_memory, data, sizeof(shared_data));
+    ctx->shared_memory->start_time = start_time;
+    data += sizeof(shared_data);
+
+    for (int line = 0; line < ctx->route_count; line++) {
+        bus_line *saved = (bus_line *)data + line;
+        bus_line *bus = &ctx->bus_lines[line];
+        bus->capacity = saved->capacity;
+        memcpy(bus->hops, saved->hops, sizeof(bus->hops));
+        bus->started = saved->started;
+        bus->finished = saved->finished;
+        bus->position = saved->position;
+        bus->at_stop = saved->at_stop;
+        bus->travel_us = saved->travel_us;
+        bus->seat_us = saved->seat_us;
+        bus->handoff_ns = saved->handoff_ns;
+        bus->handoffs = saved->handoffs;
+        bus->rng = saved->rng;
+        bus->sign_spin = saved->sign_spin;
+        bus->arrived_us = saved->arrived_us;
+        bus->trip_start_us = saved->trip_start_us;
+        bus->trip_peak = saved->trip_peak;
+        bus->trip_full = saved->trip_full;
+        bus->trip_left_behind = saved->trip_left_behind;
+        bus->report = saved->report;
+    }
+    data += sizeof(bus_line) * ctx->route_count;
+
+    memcpy(ctx->skiers, data, sizeof(skier_state) * L);
+    data += sizeof(skier_state) * L;
+
+    if (ctx->arrival_profile != SKIBUS_ARRIVALS_NONE) {
+        memcpy(ctx->arrival_schedule, data, sizeof(arrival) * L);
+        data += sizeof(arrival) * L;
+        for (int idL = 0; idL < L; idL++) {
+            skier_arrival *saved = (skier_arrival *)data + idL;
+            ctx->skier_arrivals[idL].stop = saved->stop;
+            ctx->skier_arrivals[idL].released = saved->released;
+
+            // the injector has let the skier go already
+            if (saved->released && ctx->skiers[idL].phase == SKIER_WALKING && ctx->skiers[idL].lap == 0)
+                semaphore_post(&ctx->skier_arrivals[idL].sign);
+        }
+    }
+
+    // the waiting skiers queue up again in the order of their tickets
+    int *by_ticket = malloc(sizeof(int) * (L + 1));
+    if (by_ticket == NULL)
+        return set_error(ctx, "out of memory");
+    for (int idL = 0; idL < L; idL++)
+        by_ticket[idL] = idL;
+    qsort_r(by_ticket, L, sizeof(int), compare_tickets, ctx->skiers);
+
+    for (int i = 0; i < L; i++) {
+        skier_state *skier = &ctx->skiers[by_ticket[i]];
+        route_leg *leg = &skier->legs[skier->leg];
+
+        if (skier->phase == SKIER_WAITING)
+            queue_skier(ctx, leg->line, leg->board, by_ticket[i]);
+        if (skier->phase == SKIER_RIDING) {
+            ctx->bus_lines[leg->line].occupancy++;
+            ctx->bus_lines[leg->line].stops[leg->alight].alighting++;
+        }
+    }
+    free(by_ticket);
+
+    // the model clock carries on from the checkpoint
+    struct timespec *start = &ctx->shared_memory->start_time;
+    long long real_us = header->model_time_us / ctx->time_scale;
+    start->tv_sec -= real_us / 1000000;
+    start->tv_nsec -= (real_us % 1000000) * 1000;
+    if (start->tv_nsec < 0) {
+        start->tv_sec--;
+        start->tv_nsec += 1000000000;
+    }
+    return 0;
+}
+
+/**
+ * @brief Resolves the scenario into a table per line, indexed by position, so the bus never looks
+ * anything up while it runs. Lines without a capacity take K and segments without a travel time
+ * are uniform over <0, TB>. Every segment of the scenario has to be a hop of some line.
+ * @param ctx The context, with the route network in place.
+ * @param config The configuration.
+ * @return 0 on success, -1 if the scenario does not fit the network.
+*/
+int resolve_scenario(skibus_context *ctx, const skibus_config *config) {
+    if (config->segment_count < 0 || config->segment_count > SKIBUS_MAX_SEGMENTS)
+        return set_error(ctx, "Invalid scenario");
+
+    for (int line = 0; line < MAX_LINES; line++) {
+        int capacity = config->capacities[line];
+        if (capacity < 0 || capacity > MAX_CAPACITY || (capacity > 0 && line >= ctx->route_count))
+            return set_error(ctx, "Invalid capacity in the scenario");
+        ctx->line_capacity[line] = capacity > 0 ? capacity : ctx->K;
+    }
+
+    bool used[SKIBUS_MAX_SEGMENTS] = { false };
+    for (int line = 0; line < ctx->route_count; line++) {
+        route_line *route = &ctx->routes[line];
+
+        for (int i = 0; i < route->length; i++) {
+            // the bus comes to the first stop from the terminal
+            int from = route->stops[(i + route->length - 1) % route->length], to = route->stops[i];
+            hop_time *hop = &ctx->line_hops[line][i];
+            *hop = (hop_time){ SKIBUS_TRAVEL_UNIFORM, 0, ctx->TB, 0 };
+
+            for (int j = 0; j < config->segment_count; j++) {
+                const skibus_segment *segment = &config->segments[j];
+                if (segment->from != from || segment->to != to)
+                    continue;
+                *hop = (hop_time){ segment->kind, segment->min_us, segment->max_us, segment->mean_us };
+                used[j] = true;
+            }
+        }
+    }
+
+    // the same limits as TB, a segment, that is no hop, is a mistake in the scenario
+    for (int j = 0; j < config->segment_count; j++) {
+        const skibus_segment *segment = &config->segments[j];
+        if (!used[j] || segment->min_us < 0 || segment->min_us > segment->max_us ||
+            segment->max_us > MAX_TB * ctx->time_scale ||
+            (segment->kind == SKIBUS_TRAVEL_EXPONENTIAL && segment->mean_us <= 0) ||
+            (segment->kind != SKIBUS_TRAVEL_UNIFORM && segment->kind != SKIBUS_TRAVEL_EXPONENTIAL))
+            return set_error(ctx, "Invalid segment in the scenario");
+    }
+    return 0;
+}
+
+/**
+ * @brief Takes over the configuration of a run and checks it, the same way the command line
+ * does. A restored run only takes the options, the rest comes from the checkpoint.
+ * @param ctx The context.
+ * @param config The configuration.
+ * @return 0 on success, -1 if it is invalid.
+*/
+int configure(skibus_context *ctx, const skibus_config *config) {
+    ctx->wait_strategy = config->wait_strategy;
+    ctx->skier_mode = config->skier_mode;
+    ctx->sample_memory = config->sample_memory;
+    ctx->huge_pages = config->huge_pages;
+    ctx->checkpoint_file_name = config->checkpoint_file;
+    ctx->checkpoint_interval = config->checkpoint_interval;
+
+    if (config->restore_file != NULL)
+        return 0;
+
+    ctx->L = config->L;
+    ctx->Z = config->Z;
+    ctx->K = config->K;
+    ctx->TL = config->TL;
+    ctx->TB = config->TB;
+    ctx->time_scale = config->time_scale;
+    ctx->laps = config->laps;
+    ctx->duration = config->duration;
+    ctx->arrival_profile = config->arrival_profile;
+
+    if (check_arguments(ctx) < 0)
+        return -1;
+
+    if (config->line_count == 0) {
+        default_routes(ctx);
+        return resolve_scenario(ctx, config);
+    }
+
+    if (config->line_count > MAX_LINES)
+        return set_error(ctx, "Invalid route network");
+    for (int line = 0; line < config->line_count; line++) {
+        if (config->lines[line].length < 2 || config->lines[line].length > MAX_LINE_STOPS)
+            return set_error(ctx, "Invalid route network");
+        for (int i = 0; i < config->lines[line].length; i++) {
+            if (config->lines[line].stops[i] < 1 || config->lines[line].stops[i] > MAX_STOPS)
+                return set_error(ctx, "Invalid route network");
+        }
+    }
+    ctx->route_count = config->line_count;
+    memcpy(ctx->routes, config->lines, sizeof(route_line) * config->line_count);
+    return resolve_scenario(ctx, config);
+}
+
+/**
+ * @brief Creates a context.
+ * @return The context, NULL if out of memory.
+*/
+skibus_context* skibus_create() {
+    return calloc(1, sizeof(skibus_context));
+}
+
+/**
+ * @brief Destroys a context.
+ * @param ctx The context.
+*/
+void skibus_destroy(skibus_context *ctx) {
+    free(ctx);
+}
+
+/**
+ * @brief Asks the running simulation for a checkpoint.
+ * @param ctx The context.
+*/
+void skibus_request_checkpoint(skibus_context *ctx) {
+    ctx->checkpoint_requested = 1;
+}
+
+/**
+ * @brief Returns the reason the last run failed.
+ * @param ctx The context.
+*/
+const char* skibus_error(const skibus_context *ctx) {
+    return ctx->error;
+}
+
+/**
+ * @brief Runs a simulation. The workers are forked, or cloned, from the calling thread, which
+ * then hands out their events until they are done. Everything the run has set up is torn
+ * down before it returns, so the context is ready for the next run.
+ * @param ctx The context.
+ * @param config The configuration of the run.
+ * @param callbacks The receivers of the output, NULL for none.
+ * @return 0 on success, -1 on failure.
+*/
+int skibus_run(skibus_context *ctx, const skibus_config *config, const skibus_callbacks *callbacks) {
+    checkpoint_header *restored = NULL;
+    size_t restored_size = 0;
+
+    memset(ctx, 0, sizeof(*ctx));
+    if (callbacks != NULL)
+        ctx->callbacks = *callbacks;
+
+    if (configure(ctx, config) < 0)
+        return -1;
+
+    if (config->restore_file != NULL) {
+        // the configuration comes from the checkpoint
+        restored = load_checkpoint(ctx, config->restore_file, &restored_size);
+        if (restored == NULL) {
+            // keep what was wrong with it, if it got as far as the checks
+            char reason[MAX_ERROR_LENGTH];
+            memcpy(reason, ctx->error, sizeof(reason));
+            if (reason[0] != '\0')
+                snprintf(ctx->error, sizeof(ctx->error), "Invalid checkpoint %s: %.64s", config->restore_file, reason);
+            else
+                snprintf(ctx->error, sizeof(ctx->error), "Invalid checkpoint %s", config->restore_file);
+            return -1;
+        }
+    }
+
+    find_route_ends(ctx);
+    if (ctx->L > 0 && ctx->route_origin_count == 0) {
+        if (restored != NULL)
+            munmap(restored, restored_size);
+        return set_error(ctx, "There is no stop to board a bus at");
+    }
+
+    ctx->main_rng = config->seed != 0 ? config->seed : (unsigned int)(getpid() + time(NULL));
+
+    int result = init_arena(ctx);
+    if (result == 0)
+        result = init_bus_stops(ctx);
+    if (result == 0)
+        result = init_shared_memory(ctx);
+    if (result == 0 && ctx->arrival_profile != SKIBUS_ARRIVALS_NONE)
+        result = init_arrivals(ctx);
+    if (result == 0 && restored != NULL)
+        result = restore_checkpoint(ctx, restored);
+    if (restored != NULL)
+        munmap(restored, restored_size);
+
+    if (result == 0) {
+        ctx->worker_pids = malloc(sizeof(pid_t) * (ctx->L + ctx->route_count + 1));
+        ctx->memory_pids = malloc(sizeof(pid_t) * (ctx->L + ctx->route_count + 1));
+        ctx->skier_args = malloc(sizeof(skier_worker_arg) * (ctx->L + 1));
+        if (ctx->worker_pids == NULL || ctx->memory_pids == NULL || ctx->skier_args == NULL)
+            result = set_error(ctx, "out of memory");
+    }
+
+    for (int line = 0; result == 0 && line < ctx->route_count; line++) {
+        if (!ctx->bus_lines[line].finished)
+            result = craete_ski_bus_process(ctx, line);
+    }
+
+    if (result == 0 && ctx->sample_memory) {
+        sample_memory(ctx, &ctx->memory_base);
+        ctx->memory_peak = ctx->memory_base;
+    }
+
+    if (result == 0)
+        result = create_skiers_processes(ctx);
+
+    if (result == 0 && ctx->arrival_profile != SKIBUS_ARRIVALS_NONE && ctx->shared_memory->next_arrival < ctx->L)
+        result = craete_injector_process(ctx);
+
+    if (result == 0) {
+        result = supervise(ctx);
+    } else if (ctx->worker_pids != NULL) {
+        kill_workers(ctx);
+    }
+
+    if (result == 0 && ctx->callbacks.stats != NULL) {
+        skibus_stats stats;
+        collect_statistics(ctx, &stats);
+        ctx->callbacks.stats(&stats, ctx->callbacks.user);
+    }
+
+    free(ctx->worker_pids);
+    free(ctx->memory_pids);
+    free(ctx->skier_args);
+    ctx->worker_pids = ctx->memory_pids = NULL;
+    ctx->skier_args = NULL;
+    destroy_skier_stacks(ctx);
+    destroy_arrivals(ctx);
+    destroy_bus_stops(ctx);
+    destroy_shared_memory(ctx);
+    destroy_arena(ctx);
+
+    return result;
+}
@@ -0,0 +1,438 @@
+/** AUTHOR
+_______________________________
+
+ * Name: Martin Mendl
+ * Email: x247581@fit.vutbr.cz
+ * Date: 26.4. 2024
+ * file: public interface of libskibus, the ski bus simulation library
+_______________________________
+*/
+
+
+#ifndef SKIBUS_H
+#define SKIBUS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Maximum amount of bus lines in the route network.
+ */
+#define SKIBUS_MAX_LINES 8
+
+/**
+ * Maximum amount of stops on a single bus line, the terminal included.
+ */
+#define SKIBUS_MAX_LINE_STOPS 16
+
+/**
+ * Stop IDs in the route network are in the interval <1, SKIBUS_MAX_STOPS>.
+ */
+#define SKIBUS_MAX_STOPS 64
+
+/**
+ * Amount of skiers has to be below this.
+ */
+#define SKIBUS_MAX_SKIERS 20000
+
+/**
+ * Largest allowed bus capacity.
+ */
+#define SKIBUS_MAX_CAPACITY 100
+
+/**
+ * Upper bound of TL in real microseconds, scaled by the time scale for model time.
+ */
+#define SKIBUS_MAX_TL 10000
+
+/**
+ * Upper bound of TB in real microseconds, scaled by the time scale for model time.
+ */
+#define SKIBUS_MAX_TB 1000
+
+/**
+ * Maximum amount of segments with a travel time of their own in a scenario.
+ */
+#define SKIBUS_MAX_SEGMENTS 256
+
+/**
+ * @brief Shapes of the first arrivals of the skiers.
+ */
+typedef enum {
+    SKIBUS_ARRIVALS_NONE, /**< Every skier sleeps up to TL on its own. */
+    SKIBUS_ARRIVALS_UNIFORM, /**< Uniform over TL. */
+    SKIBUS_ARRIVALS_POISSON, /**< Poisson process with a rate of L skiers per TL. */
+    SKIBUS_ARRIVALS_PEAK, /**< Triangular morning peak in the middle of TL. */
+    SKIBUS_ARRIVALS_BURSTY, /**< Groups of up to K skiers arriving together at one stop. */
+} skibus_arrival_profile;
+
+/**
+ * @brief How the bus and the skiers wait for each other at a stop.
+ */
+typedef enum {
+    SKIBUS_WAIT_BLOCK, /**< Block in sem_wait right away. */
+    SKIBUS_WAIT_ADAPTIVE, /**< Spin for an adaptive budget first, then block. */
+} skibus_wait_strategy;
+
+/**
+ * @brief How the skiers are run.
+ */
+typedef enum {
+    SKIBUS_SKIERS_PROCESS, /**< Every skier is a forked process. */
+    SKIBUS_SKIERS_CLONE, /**< Every skier is a clone sharing the address space of the caller, on a small stack. */
+} skibus_skier_mode;
+
+/**
+ * @brief Pages backing the shared memory of a run.
+ */
+typedef enum {
+    SKIBUS_PAGES_NORMAL, /**< Regular pages. */
+    SKIBUS_PAGES_TRANSPARENT, /**< Transparent huge pages, asked for with madvise. */
+    SKIBUS_PAGES_HUGETLB, /**< Reserved huge pages, transparent ones if none are reserved. */
+} skibus_page_backing;
+
+/**
+ * @brief Distributions of the travel time of the bus over a segment.
+ */
+typedef enum {
+    SKIBUS_TRAVEL_UNIFORM, /**< Uniform over <min_us, max_us>, fixed when they are equal. */
+    SKIBUS_TRAVEL_EXPONENTIAL, /**< min_us plus an exponential with a mean of mean_us, cut off at max_us. */
+} skibus_travel_kind;
+
+/**
+ * @brief Travel time of the bus from one stop to the next one on its line.
+ */
+typedef struct {
+    int from; /**< ID of the stop the bus leaves. */
+    int to; /**< ID of the stop the bus travels to. */
+    skibus_travel_kind kind; /**< Distribution of the travel time. */
+    long min_us; /**< Shortest travel time in model microseconds. */
+    long max_us; /**< Longest travel time in model microseconds. */
+    long mean_us; /**< Mean of the exponential part in model microseconds, unused for uniform. */
+} skibus_segment;
+
+/**
+ * @brief One bus line of the route network.
+ */
+typedef struct {
+    int length; /**< Amount of stops on the line, the last one is the terminal at a lift. */
+    int stops[SKIBUS_MAX_LINE_STOPS]; /**< IDs of the stops in the order the bus visits them. */
+} skibus_line;
+
+/**
+ * @brief Configuration of a run.
+ */
+typedef struct {
+    long L; /**< Number of skiers. */
+    long Z; /**< Number of bus stops of the default line. */
+    long K; /**< Maximum bus capacity. */
+    long TL; /**< Max time in model microseconds for a skier to get to the stop. */
+    long TB; /**< Max time in model microseconds for the bus to get to the next stop. */
+    double time_scale; /**< Factor by which model time runs faster than real time. */
+    long laps; /**< Amount of laps every skier does. */
+    long long duration; /**< Model microseconds after which skiers stop starting new laps, 0 to count laps instead. */
+    skibus_arrival_profile arrival_profile; /**< Profile of the precomputed arrival schedule. */
+    skibus_wait_strategy wait_strategy; /**< Wait strategy of the handshake points. */
+    skibus_skier_mode skier_mode; /**< How the skiers are run. */
+    skibus_page_backing huge_pages; /**< Pages to back the shared memory with. */
+    int line_count; /**< Amount of bus lines, 0 for the default single line of Z stops. */
+    skibus_line lines[SKIBUS_MAX_LINES]; /**< The route network. */
+    int capacities[SKIBUS_MAX_LINES]; /**< Capacity of the bus of every line, 0 for K. */
+    int segment_count; /**< Amount of segments with a travel time of their own. */
+    skibus_segment segments[SKIBUS_MAX_SEGMENTS]; /**< Travel times of the segments, the others are uniform over <0, TB>. */
+    unsigned int seed; /**< Seed of the random streams, 0 to seed from the process and the clock. */
+    bool sample_memory; /**< Sample the memory of the workers for the statistics. */
+    const char *checkpoint_file; /**< Checkpoint file, NULL to disable checkpoints. */
+    double checkpoint_interval; /**< Model seconds between checkpoints, 0 to only checkpoint on request. */
+    const char *restore_file; /**< Checkpoint to resume from, its configuration replaces L to lines. */
+} skibus_config;
+
+/**
+ * @brief Kinds of the events of a run, one per line of the classic log.
+ */
+typedef enum {
+    SKIBUS_BUS_STARTED, /**< BUS: started */
+    SKIBUS_BUS_ARRIVED, /**< BUS: arrived to stop */
+    SKIBUS_BUS_LEAVING, /**< BUS: leaving stop */
+    SKIBUS_BUS_ARRIVED_FINAL, /**< BUS: arrived to final */
+    SKIBUS_BUS_LEAVING_FINAL, /**< BUS: leaving final */
+    SKIBUS_BUS_FINISHED, /**< BUS: finish */
+    SKIBUS_SKIER_STARTED, /**< L skier: started */
+    SKIBUS_SKIER_ARRIVED, /**< L skier: arrived to stop */
+    SKIBUS_SKIER_BOARDING, /**< L skier: boarding */
+    SKIBUS_SKIER_TRANSFERRING, /**< L skier: transferring at stop */
+    SKIBUS_SKIER_SKI, /**< L skier: going to ski */
+} skibus_event_type;
+
+/**
+ * @brief One event of a run.
+ */
+typedef struct {
+    int id; /**< Number of the event, they are delivered in order from 1. */
+    skibus_event_type type; /**< What happened. */
+    int bus; /**< Number of the bus from 1, 0 with a single line or for a skier. */
+    int skier; /**< ID of the skier from 1, 0 for a bus. */
+    int stop; /**< ID of the stop, also for the final stop, boarding and going to ski, 0 if the event has none. */
+    long long model_time_us; /**< Model time of the event. */
+} skibus_event;
+
+/**
+ * @brief What the bus of a line has seen at one of its stops, counted when it leaves.
+ */
+typedef struct {
+    int stop; /**< ID of the stop. */
+    long long visits; /**< Times the bus has left the stop. */
+    long long empty_visits; /**< Visits nobody boarded or left the bus at. */
+    long long boarded; /**< Skiers, that got on. */
+    long long alighted; /**< Skiers, that got off. */
+    long long left_behind; /**< Skiers, that stayed at the stop, because the bus was full. */
+    long long load_sum; /**< Sum of the riders on board when leaving, over the visits. */
+    int max_load; /**< Most riders on board when leaving. */
+    long long dwell_us; /**< Time the bus has spent at the stop, from arriving to leaving. */
+} skibus_stop_stats;
+
+/**
+ * @brief Trips of the bus of a line, a trip ends by leaving the final stop.
+ */
+typedef struct {
+    int length; /**< Amount of stops on the line. */
+    int capacity; /**< Capacity of the bus of the line. */
+    long long trips; /**< Finished trips. */
+    long long trip_us; /**< Time of the finished trips. */
+    long long peak_load_sum; /**< Sum of the highest load of every trip. */
+    long long full_trips; /**< Trips, that left a stop with every seat taken. */
+    long long left_behind_trips; /**< Trips, that left a skier behind at a stop. */
+    skibus_stop_stats stops[SKIBUS_MAX_LINE_STOPS]; /**< Per stop, in the order the bus visits them. */
+} skibus_line_stats;
+
+/**
+ * @brief Statistics of a finished run, all times are model time unless said otherwise.
+ */
+typedef struct {
+    int events; /**< Amount of events. */
+    int skiers_transported; /**< Amount of rides, that have reached a lift. */
+    double time_scale; /**< Factor of model time over real time. */
+    long long model_time_us; /**< Length of the run. */
+    long long real_time_us; /**< Length of the run in real time. */
+    long long bus_travel_us; /**< Time the buses of all lines have spent travelling. */
+    double bus_utilization; /**< Average share of the seats taken while travelling, in the interval <0, 1>. */
+    double steady_throughput; /**< Skiers per second in the steady state, negative without enough laps. */
+    long long wait_p50_us; /**< Upper bound of the median boarding wait. */
+    long long wait_p99_us; /**< Upper bound of the 99th percentile of the boarding wait. */
+    long long wait_max_us; /**< Longest boarding wait. */
+    skibus_wait_strategy wait_strategy; /**< Wait strategy of the handshake points. */
+    long long spin_hits; /**< Handshake waits that were over while spinning. */
+    long long spin_blocks; /**< Handshake waits that had to block. */
+    long long handoff_ns; /**< Real time the buses have spent letting skiers on and off. */
+    long long handoffs; /**< Amount of times the buses have let skiers on or off. */
+    skibus_skier_mode skier_mode; /**< How the skiers were run. */
+    int skier_workers; /**< Amount of skier processes or clones. */
+    bool memory_sampled; /**< The memory fields below are filled in. */
+    long long peak_rss_kb; /**< Peak resident set summed over the processes, shared pages count in every one. */
+    long long peak_pss_kb; /**< Peak proportional set of the caller and the workers. */
+    long long base_pss_kb; /**< Proportional set before the skiers were created. */
+    long long peak_kernel_kb; /**< Peak kernel stacks and page tables of the whole system. */
+    long long base_kernel_kb; /**< Kernel stacks and page tables before the skiers were created. */
+    double memory_per_skier_kb; /**< Memory every skier has added at the peak. */
+    long long arena_kb; /**< Size of the shared memory of the run. */
+    skibus_page_backing page_backing; /**< Pages the shared memory got, it may fall back from huge pages. */
+    long K; /**< Default capacity of the buses, every line has its own in lines. */
+    int line_count; /**< Amount of bus lines. */
+    skibus_line_stats lines[SKIBUS_MAX_LINES]; /**< Trips and stops of every line. */
+} skibus_stats;
+
+/**
+ * @brief Receivers of the output of a run, they are called from the thread running it.
+ */
+typedef struct {
+    void (*event)(const skibus_event *event, void *user); /**< Every event in order, NULL to drop them. */
+    void (*checkpoint)(void *user); /**< A checkpoint is taken, every event before it has been delivered. */
+    void (*stats)(const skibus_stats *stats, void *user); /**< Once, when the run is over. */
+    void *user; /**< Passed to the receivers. */
+} skibus_callbacks;
+
+/**
+ * @brief State of the runs of one caller, every thread needs its own.
+ */
+typedef struct skibus_context skibus_context;
+
+/**
+ * @brief Fills in the configuration of the command line defaults, L to TB are left zero.
+ *
+ * @param config The configuration.
+ */
+void skibus_default_config(skibus_config *config);
+
+/**
+ * @brief Loads the route network from a file into a configuration.
+ *
+ * @param config The configuration.
+ * @param file_name The route network file.
+ * @return 0 on success, -1 if the file is invalid.
+ */
+int skibus_load_routes(skibus_config *config, const char *file_name);
+
+/**
+ * @brief Loads the bus capacities and the segment travel times from a scenario file into a configuration.
+ *
+ * @param config The configuration.
+ * @param file_name The scenario file.
+ * @return 0 on success, -1 if the file is invalid.
+ */
+int skibus_load_scenario(skibus_config *config, const char *file_name);
+
+/**
+ * @brief Creates a context, it can be used for any amount of runs one after another.
+ *
+ * @return The context, NULL if out of memory.
+ */
+skibus_context* skibus_create();
+
+/**
+ * @brief Destroys a context.
+ *
+ * @param ctx The context.
+ */
+void skibus_destroy(skibus_context *ctx);
+
+/**
+ * @brief Runs a simulation and streams its events and statistics to the callbacks.
+ *
+ * @param ctx The context, not running another simulation.
+ * @param config The configuration of the run.
+ * @param callbacks The receivers of the output, NULL for none.
+ * @return 0 on success, -1 on failure, see skibus_error.
+ */
+int skibus_run(skibus_context *ctx, const skibus_config *config, const skibus_callbacks *callbacks);
+
+/**
+ * @brief Asks the running simulation for a checkpoint, safe to call from a signal handler.
+ *
+ * @param ctx The context.
+ */
+void skibus_request_checkpoint(skibus_context *ctx);
+
+/**
+ * @brief Returns the reason the last run failed.
+ *
+ * @param ctx The context.
+ */
+const char* skibus_error(const skibus_context *ctx);
+
+/**
+ * @brief Formats an event as a line of the classic log, without the newline.
+ *
+ * @param event The event.
+ * @param buffer The buffer to fill.
+ * @param size The size of the buffer.
+ * @return The length of the line, as snprintf.
+ */
+int skibus_format_event(const skibus_event *event, char *buffer, size_t size);
+
+/**
+ * @brief One event of an indexed log.
+ */
+typedef struct {
+    long long offset; /**< Offset of the line of the event in the log. */
+    long long model_time_us; /**< Model time of the event. */
+    int skier; /**< ID of the skier, 0 for a bus. */
+    unsigned char type; /**< What happened, a skibus_event_type. */
+    unsigned char bus; /**< Number of the bus, as in skibus_event. */
+    unsigned char stop; /**< ID of the stop, 0 if the event has none. */
+    unsigned char reserved; /**< Zero. */
+} skibus_index_entry;
+
+/**
+ * @brief Index of a log by skier and by stop, it is built while the log is written and
+ * saved next to it, then opened mapped for queries.
+ */
+typedef struct skibus_index skibus_index;
+
+/**
+ * @brief Creates an empty index to build while writing a log.
+ *
+ * @return The index, NULL if out of memory.
+ */
+skibus_index* skibus_index_create();
+
+/**
+ * @brief Adds an event to an index being built.
+ *
+ * @param index The index.
+ * @param event The event, the events have to come in order from ID 1.
+ * @param offset The offset of the line of the event in the log.
+ * @return 0 on success, -1 if out of memory or out of order.
+ */
+int skibus_index_add(skibus_index *index, const skibus_event *event, long long offset);
+
+/**
+ * @brief Saves an index being built.
+ *
+ * @param index The index.
+ * @param file_name The index file.
+ * @param log_size The size of the log once it is complete.
+ * @return 0 on success, -1 if the file could not be written.
+ */
+int skibus_index_save(const skibus_index *index, const char *file_name, long long log_size);
+
+/**
+ * @brief Maps a saved index for queries.
+ *
+ * @param file_name The index file.
+ * @return The index, NULL if it is invalid.
+ */
+skibus_index* skibus_index_open(const char *file_name);
+
+/**
+ * @brief Destroys an index, built or opened.
+ *
+ * @param index The index.
+ */
+void skibus_index_destroy(skibus_index *index);
+
+/**
+ * @brief Returns the amount of events in an index.
+ *
+ * @param index The index.
+ */
+int skibus_index_events(const skibus_index *index);
+
+/**
+ * @brief Returns the size of the log an opened index was saved for.
+ *
+ * @param index The index.
+ */
+long long skibus_index_log_size(const skibus_index *index);
+
+/**
+ * @brief Returns an event of an index.
+ *
+ * @param index The index.
+ * @param id The ID of the event.
+ * @return The event, NULL if there is no such event.
+ */
+const skibus_index_entry* skibus_index_event(const skibus_index *index, int id);
+
+/**
+ * @brief Returns the events of a skier in an opened index.
+ *
+ * @param index The index.
+ * @param skier The ID of the skier.
+ * @param ids Filled with the IDs of the events, in order.
+ * @return The amount of events.
+ */
+int skibus_index_skier(const skibus_index *index, int skier, const int **ids);
+
+/**
+ * @brief Returns the events at a stop in a range of IDs in an opened index.
+ *
+ * @param index The index.
+ * @param stop The ID of the stop.
+ * @param first The first ID of the range.
+ * @param last The last ID of the range.
+ * @param ids Filled with the IDs of the events, in order.
+ * @return The amount of events.
+ */
+int skibus_index_stop(const skibus_index *index, int stop, int first, int last, const int **ids);
+
+#endif